@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "common.h"
+#include "policy_simulation.h"
+#include "next_use.h"
+#include "workload.h"
+
+
+// A policy is reported as slower when its median rate drops by more than this
+// percentage of the baseline, unless -x says otherwise
+#define BENCH_SLOWDOWN_THRESHOLD 10.0
+#define BENCH_MAX_RESULTS 1024
+#define BENCH_MAX_CAPACITIES 32
+// Accesses per call to the specialized replay loop, as in the simulator
+#define BENCH_BATCH_SIZE 4096
+
+
+struct bench_opts {
+	unsigned long num_events;
+	// Simulated cache sizes in folios, none for a quarter of the working set
+	unsigned long capacities[BENCH_MAX_CAPACITIES];
+	int num_capacities;
+	int repeats;
+	int patterns[NUM_WORKLOAD_PATTERNS];
+	int num_patterns;
+	struct workload_opts workload;
+	const char *output;
+	const char *baseline;
+	double threshold;
+	// Replay through the policy hooks, as plugins are, instead of the
+	// specialized loops
+	bool generic;
+};
+
+struct bench_result {
+	char workload[16];
+	char policy[16];
+	unsigned long capacity;
+	// Median over the repeats, and the gap between the fastest and slowest
+	// repeat as a percentage of it
+	double rate;
+	double spread;
+	long peak_rss_kb;
+	double hit_percent;
+};
+
+
+// Parses a comma separated list of folio counts with an optional K or M
+// suffix, where start:end is every doubling in between, as the simulator's -c
+// does for sizes. Returns 0 on success.
+int bench_parse_capacities(char *arg, struct bench_opts *opts) {
+	for (char *item = strtok(arg, ","); item; item = strtok(NULL, ",")) {
+		unsigned long range[2];
+		char *p = item;
+		for (int i = 0; i < 2; i++) {
+			char *end;
+			range[i] = strtoul(p, &end, 10);
+			if (*end == 'K' || *end == 'M') {
+				range[i] <<= *end == 'K' ? 10 : 20;
+				end++;
+			}
+			if (end == p || (*end && (i || *end != ':'))) {
+				return -1;
+			}
+			if (!*end) {
+				range[1] = range[i];
+				break;
+			}
+			p = end + 1;
+		}
+		if (!range[0] || range[1] < range[0]) {
+			return -1;
+		}
+		for (unsigned long capacity = range[0]; capacity <= range[1]; capacity *= 2) {
+			if (opts->num_capacities == BENCH_MAX_CAPACITIES) {
+				return -1;
+			}
+			opts->capacities[opts->num_capacities++] = capacity;
+		}
+	}
+	return 0;
+}
+
+// CPU time rather than wall time, so other load on the machine doesn't show
+// up as a slower replay
+double cpu_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reads a kB field such as VmHWM from /proc/self/status, 0 if it isn't there
+long proc_status_kb(const char *field) {
+	FILE *f = fopen("/proc/self/status", "r");
+	if (!f) {
+		return 0;
+	}
+	char line[256];
+	long kb = 0;
+	size_t len = strlen(field);
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, field, len) && line[len] == ':') {
+			kb = strtol(line + len + 1, NULL, 10);
+			break;
+		}
+	}
+	fclose(f);
+	return kb;
+}
+
+// Replays the events through one policy in a fresh process, so every repeat
+// starts from the same heap and the high water mark of the RSS only covers
+// this simulation. The memory of the events themselves was resident before
+// the fork and isn't counted.
+void bench_replay(const struct policy *policy, const struct event *events, unsigned long num_events, unsigned long capacity, bool generic, struct bench_result *r) {
+	int fds[2];
+	if (pipe(fds)) {
+		perror("pipe");
+		exit(1);
+	}
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+
+	if (!pid) {
+		close(fds[0]);
+		long start_rss = proc_status_kb("VmRSS");
+		struct policy_simulation *ps = policy_simulation_init(policy, capacity);
+		if (policy == &opt_policy) {
+			// OPT's index is part of its memory, but not of its replay time
+			struct next_use *nu = next_use_init();
+			for (unsigned long n = 0; n < num_events; n++) {
+				next_use_track(nu, &events[n]);
+			}
+			next_use_finish(nu);
+			opt_init(ps, nu);
+		}
+
+		double start = cpu_seconds();
+		if (generic) {
+			for (unsigned long n = 0; n < num_events; n++) {
+				policy_simulation_track_access(ps, &events[n]);
+			}
+		} else {
+			for (unsigned long n = 0; n < num_events; n += BENCH_BATCH_SIZE) {
+				unsigned long batch_size = num_events - n < BENCH_BATCH_SIZE ? num_events - n : BENCH_BATCH_SIZE;
+				unsigned int max_task_id = 0;
+				for (unsigned long i = n; i < n + batch_size; i++) {
+					if (events[i].type != SFL && events[i].task_id > max_task_id) {
+						max_task_id = events[i].task_id;
+					}
+				}
+				policy_simulation_track_accesses(ps, &events[n], batch_size, max_task_id);
+			}
+		}
+		double elapsed = cpu_seconds() - start;
+
+		r->rate = num_events / elapsed;
+		r->hit_percent = policy_simulation_total_hit_percent(ps);
+		r->peak_rss_kb = proc_status_kb("VmHWM") - start_rss;
+		if (write(fds[1], r, sizeof(struct bench_result)) != sizeof(struct bench_result)) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	int status;
+	ssize_t size = read(fds[0], r, sizeof(struct bench_result));
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+	if (size != sizeof(struct bench_result)) {
+		printf("Replaying %s failed\n", policy->name);
+		exit(1);
+	}
+}
+
+int compare_rates(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Repeats the replay and keeps the median rate, which one slow repeat
+// caused by the rest of the machine can't move
+void bench_run(const struct policy *policy, const struct event *events, unsigned long num_events, unsigned long capacity, int repeats, bool generic, struct bench_result *r) {
+	double rates[repeats];
+	for (int i = 0; i < repeats; i++) {
+		bench_replay(policy, events, num_events, capacity, generic, r);
+		rates[i] = r->rate;
+	}
+	qsort(rates, repeats, sizeof(double), compare_rates);
+	r->rate = rates[repeats / 2];
+	r->spread = 100 * (rates[repeats - 1] - rates[0]) / r->rate;
+	snprintf(r->policy, sizeof(r->policy), "%s", policy->name);
+	r->capacity = capacity;
+}
+
+// Reads results written with -o, returns the number read
+int bench_load_results(const char *path, struct bench_result *results) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return -1;
+	}
+	char line[256];
+	int n = 0;
+	while (n < BENCH_MAX_RESULTS && fgets(line, sizeof(line), f)) {
+		struct bench_result *r = &results[n];
+		memset(r, 0, sizeof(struct bench_result));
+		if (sscanf(line, "%15[^,],%15[^,],%lu,%lf,%ld,%lf", r->workload, r->policy, &r->capacity, &r->rate, &r->peak_rss_kb, &r->hit_percent) == 6) {
+			n++;
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+// Prints every result that got slower than the baseline or simulates
+// differently, returns the number of them
+int bench_compare(const struct bench_result *results, int num_results, const struct bench_result *baseline, int num_baseline, double threshold) {
+	int regressions = 0;
+	for (int i = 0; i < num_results; i++) {
+		const struct bench_result *r = &results[i];
+		for (int j = 0; j < num_baseline; j++) {
+			const struct bench_result *b = &baseline[j];
+			if (strcmp(r->workload, b->workload) || strcmp(r->policy, b->policy) || r->capacity != b->capacity) {
+				continue;
+			}
+			if (r->rate < b->rate * (1 - threshold / 100)) {
+				printf("Slower: %s %s %lu folios %.0f events/sec, was %.0f (%+.1f%%)\n", r->workload, r->policy, r->capacity, r->rate, b->rate, 100 * (r->rate / b->rate - 1));
+				regressions++;
+			}
+			// Hit % is printed with 2 decimals, so a smaller change is rounding
+			if (r->hit_percent - b->hit_percent > 0.01 || b->hit_percent - r->hit_percent > 0.01) {
+				printf("Changed: %s %s %lu folios hit %% %.2f, was %.2f\n", r->workload, r->policy, r->capacity, r->hit_percent, b->hit_percent);
+				regressions++;
+			}
+		}
+	}
+	return regressions;
+}
+
+
+int main(int argc, char **argv) {
+	struct bench_opts opts;
+	opts.num_events = 1000000;
+	opts.num_capacities = 0;
+	opts.repeats = 5;
+	opts.num_patterns = 0;
+	opts.workload.num_folios = 1 << 18;
+	opts.workload.num_tasks = 4;
+	opts.workload.alpha = 0.9;
+	opts.workload.seed = 1;
+	opts.output = NULL;
+	opts.baseline = NULL;
+	opts.threshold = BENCH_SLOWDOWN_THRESHOLD;
+	opts.generic = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:f:k:t:a:r:w:o:b:x:g")) != -1) {
+		switch(opt) {
+			case 'n':
+				opts.num_events = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				opts.workload.num_folios = strtoul(optarg, NULL, 10);
+				break;
+			case 'k':
+				if (bench_parse_capacities(optarg, &opts)) {
+					printf("Invalid capacity list: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 't':
+				opts.workload.num_tasks = strtoul(optarg, NULL, 10);
+				break;
+			case 'a':
+				opts.workload.alpha = strtod(optarg, NULL);
+				break;
+			case 'r':
+				opts.repeats = atoi(optarg);
+				if (opts.repeats < 1) {
+					printf("Repeats must be at least 1\n");
+					return 1;
+				}
+				break;
+			case 'w': {
+				char *saveptr;
+				for (char *name = strtok_r(optarg, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+					int pattern = workload_parse_pattern(name);
+					if (pattern < 0) {
+						printf("Unknown pattern: %s\n", name);
+						return 1;
+					}
+					if (opts.num_patterns < NUM_WORKLOAD_PATTERNS) {
+						opts.patterns[opts.num_patterns++] = pattern;
+					}
+				}
+				break;
+			}
+			case 'o':
+				opts.output = optarg;
+				break;
+			case 'b':
+				opts.baseline = optarg;
+				break;
+			case 'x':
+				opts.threshold = strtod(optarg, NULL);
+				break;
+			case 'g':
+				opts.generic = true;
+				break;
+			case '?':
+				printf("Usage: %s [-w patterns] [-n events] [-f folios] [-k capacities] [-t tasks] [-a alpha] [-r repeats] [-g] [-o results.csv] [-b baseline.csv [-x percent]]\n", argv[0]);
+				printf("-w: Workloads to replay, e.g. zipf,loop (default all of zipf, uniform, loop, sequential and mixed)\n");
+				printf("-n: Events per workload (default 1000000)\n");
+				printf("-f: Folios in the working set, per task for mixed (default 262144)\n");
+				printf("-k: Cache sizes in folios, e.g. 4096,64K or 1K:1M for every doubling in between (default a quarter of the working set)\n");
+				printf("-t: Number of tasks (default 4)\n");
+				printf("-a: Zipf exponent (default 0.9)\n");
+				printf("-r: Replays per policy and workload, the median rate is reported (default 5)\n");
+				printf("-g: Replay through the policy hooks, as for plugins, instead of the specialized loops\n");
+				printf("-o: Write the results to a CSV file\n");
+				printf("-b: Compare the results to a CSV file written by -o, and fail on regressions\n");
+				printf("-x: Slowdown in %% that counts as a regression (default 10)\n");
+				return 1;
+		}
+	}
+	if (!opts.num_patterns) {
+		for (int i = 0; i < NUM_WORKLOAD_PATTERNS; i++) {
+			opts.patterns[opts.num_patterns++] = i;
+		}
+	}
+	if (!opts.num_capacities) {
+		opts.capacities[opts.num_capacities++] = opts.workload.num_folios / 4 ? opts.workload.num_folios / 4 : 1;
+	}
+
+	const struct policy *bench_policies[16];
+	int num_policies = 0;
+	while (policies[num_policies]) {
+		bench_policies[num_policies] = policies[num_policies];
+		num_policies++;
+	}
+	bench_policies[num_policies++] = &opt_policy;
+
+	struct bench_result results[BENCH_MAX_RESULTS];
+	int num_results = 0;
+	struct event *events = (struct event *)malloc(opts.num_events * sizeof(struct event));
+
+	printf("%lu events per workload, %lu folios per working set, median of %d replays\n\n", opts.num_events, opts.workload.num_folios, opts.repeats);
+	printf("%-16s    %-16s    %-16s    %-16s    %-16s    %-16s    %-16s\n", "Workload", "Policy", "Capacity", "Events/sec", "Spread %", "Peak RSS MB", "Hit %");
+	for (int p = 0; p < opts.num_patterns; p++) {
+		opts.workload.pattern = opts.patterns[p];
+		struct workload *w = workload_init(&opts.workload);
+		for (unsigned long n = 0; n < opts.num_events; n++) {
+			workload_next(w, &events[n]);
+			// The position OPT's next use index is keyed by
+			events[n].seq = n;
+		}
+		workload_destroy(w);
+
+		for (int c = 0; c < opts.num_capacities; c++) {
+			for (int i = 0; i < num_policies && num_results < BENCH_MAX_RESULTS; i++) {
+				struct bench_result *r = &results[num_results++];
+				bench_run(bench_policies[i], events, opts.num_events, opts.capacities[c], opts.repeats, opts.generic, r);
+				snprintf(r->workload, sizeof(r->workload), "%s", workload_pattern_names[opts.patterns[p]]);
+				printf("%-16s    %-16s    %-16lu    %-16.0f    %-16.1f    %-16.1f    %-16.2f\n", r->workload, r->policy, r->capacity, r->rate, r->spread, r->peak_rss_kb / 1024.0, r->hit_percent);
+				fflush(stdout);
+			}
+		}
+	}
+	free(events);
+
+	if (opts.output) {
+		FILE *f = fopen(opts.output, "w");
+		if (!f) {
+			printf("Failed to open %s\n", opts.output);
+			return 1;
+		}
+		fprintf(f, "workload,policy,capacity,events_per_sec,peak_rss_kb,hit_percent\n");
+		for (int i = 0; i < num_results; i++) {
+			fprintf(f, "%s,%s,%lu,%.0f,%ld,%.4f\n", results[i].workload, results[i].policy, results[i].capacity, results[i].rate, results[i].peak_rss_kb, results[i].hit_percent);
+		}
+		fclose(f);
+	}
+
+	if (opts.baseline) {
+		struct bench_result baseline[BENCH_MAX_RESULTS];
+		int num_baseline = bench_load_results(opts.baseline, baseline);
+		if (num_baseline < 0) {
+			printf("Failed to open %s\n", opts.baseline);
+			return 1;
+		}
+		printf("\n");
+		int regressions = bench_compare(results, num_results, baseline, num_baseline, opts.threshold);
+		printf("%d regressions against %s\n", regressions, opts.baseline);
+		return regressions ? 1 : 0;
+	}
+
+	return 0;
+}
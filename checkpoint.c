@@ -0,0 +1,108 @@
+#include "checkpoint.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+
+// Writes go to path.tmp until checkpoint_commit, so a crash mid-write leaves
+// the previous checkpoint intact
+struct checkpoint *checkpoint_create(const char *path) {
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	FILE *file = fopen(tmp_path, "wb");
+	if (!file) {
+		return NULL;
+	}
+	struct checkpoint *c = (struct checkpoint *)malloc(sizeof(struct checkpoint));
+	c->file = file;
+	c->size = 0;
+	c->failed = 0;
+	return c;
+}
+
+// Closes a checkpoint from checkpoint_create and moves it over path. Returns 0
+// on success, and leaves path alone if anything failed.
+int checkpoint_commit(struct checkpoint *c, const char *path) {
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	int failed = c->failed;
+	if (fclose(c->file)) {
+		failed = 1;
+	}
+	free(c);
+	if (failed || rename(tmp_path, path)) {
+		remove(tmp_path);
+		return -1;
+	}
+	return 0;
+}
+
+struct checkpoint *checkpoint_open(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fileno(file), &st)) {
+		fclose(file);
+		return NULL;
+	}
+	struct checkpoint *c = (struct checkpoint *)malloc(sizeof(struct checkpoint));
+	c->file = file;
+	c->size = st.st_size;
+	c->failed = 0;
+	return c;
+}
+
+void checkpoint_close(struct checkpoint *c) {
+	fclose(c->file);
+	free(c);
+}
+
+void checkpoint_write(struct checkpoint *c, const void *data, size_t size) {
+	if (!c->failed && size && fwrite(data, size, 1, c->file) != 1) {
+		c->failed = 1;
+	}
+}
+
+// Reads size bytes into data, or zeroes it once the checkpoint has failed
+void checkpoint_read(struct checkpoint *c, void *data, size_t size) {
+	if (!c->failed && size && fread(data, size, 1, c->file) != 1) {
+		c->failed = 1;
+	}
+	if (c->failed) {
+		memset(data, 0, size);
+	}
+}
+
+// Writes count followed by count elements of size bytes
+void checkpoint_write_array(struct checkpoint *c, const void *data, size_t size, uint64_t count) {
+	checkpoint_write(c, &count, sizeof(count));
+	checkpoint_write(c, data, size * count);
+}
+
+// Reads an array written by checkpoint_write_array into a new allocation and
+// sets *count. The allocation is never empty, and it is zeroed on failure.
+void *checkpoint_read_array(struct checkpoint *c, size_t size, uint64_t *count) {
+	checkpoint_read(c, count, sizeof(*count));
+	if (*count > c->size / size) {
+		c->failed = 1;
+		*count = 0;
+	}
+	void *data = calloc(*count ? *count : 1, size);
+	checkpoint_read(c, data, size * *count);
+	if (c->failed) {
+		*count = 0;
+	}
+	return data;
+}
+
+// FNV-1a
+uint64_t checkpoint_fingerprint(const char *data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325UL;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 0x100000001b3UL;
+	}
+	return hash;
+}
@@ -0,0 +1,61 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Checkpoint layout: a checkpoint_header followed by the state of the
+ * linux_stats, the sampler if there is one, and every simulation in order.
+ * Each module writes its own state with checkpoint_write, as packed native
+ * integers and arrays with their lengths in front. A checkpoint is only
+ * read back by the same build on the same machine, so nothing is converted.
+ */
+#define CHECKPOINT_MAGIC "CSIMCKP"
+#define CHECKPOINT_VERSION 2
+// Bytes of trace before the resume point that are hashed into the fingerprint
+#define CHECKPOINT_FINGERPRINT_SIZE 4096
+
+struct checkpoint_header {
+	char magic[8];
+	uint32_t version;
+	// Where the replay stopped: the trace format, the chunk to resume at, the
+	// byte offset it starts at, and how many of its events were replayed
+	uint32_t trace_format;
+	uint64_t chunk;
+	uint64_t trace_offset;
+	uint64_t chunk_events;
+	// Hash of the trace bytes right before trace_offset, so a checkpoint isn't
+	// resumed on a different trace
+	uint64_t fingerprint;
+	// Events replayed so far, which is also the seq of the next one
+	uint64_t num_events;
+	// Options the state depends on, which a resumed run has to repeat
+	uint32_t num_sims;
+	uint32_t simulate_evictions;
+	double sampling_rate;
+	uint64_t max_sampled;
+} __attribute__((packed));
+
+struct checkpoint {
+	FILE *file;
+	// Size of a checkpoint being read, which no array in it can be longer than
+	uint64_t size;
+	// Set by the first failed read or write. Later ones do nothing, so a
+	// caller only has to check it once at the end.
+	int failed;
+};
+
+
+struct checkpoint *checkpoint_create(const char *path);
+int checkpoint_commit(struct checkpoint *c, const char *path);
+struct checkpoint *checkpoint_open(const char *path);
+void checkpoint_close(struct checkpoint *c);
+void checkpoint_write(struct checkpoint *c, const void *data, size_t size);
+void checkpoint_read(struct checkpoint *c, void *data, size_t size);
+void checkpoint_write_array(struct checkpoint *c, const void *data, size_t size, uint64_t count);
+void *checkpoint_read_array(struct checkpoint *c, size_t size, uint64_t *count);
+uint64_t checkpoint_fingerprint(const char *data, size_t size);
+
+#endif
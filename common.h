@@ -22,7 +22,32 @@ struct event {
 		unsigned long num_evicted;
 	};
 	enum access_type type;
+	// Number of accesses the event stands for. The profiler can fold repeated
+	// FMAs of a folio by the same task into one event, otherwise it is 1.
+	unsigned int count;
 	struct task_key key;
+	// Dense id of key, assigned by the simulator when the event is decoded.
+	// The profiler leaves it unset.
+	unsigned int task_id;
+	// CPU the event happened on
+	unsigned int cpu;
+	// Global order of the event, so events from per-CPU buffers can be merged
+	unsigned long seq;
+	// When the event happened, in ns. The profiler records CLOCK_MONOTONIC and
+	// page.log holds Unix time. 0 if the trace has no times.
+	unsigned long time;
+};
+
+// Slots per CPU in the profiler's FMA deduplication table
+#define DEDUP_SLOTS 64
+
+// Limits on the profiler's in-kernel filters
+#define FILTER_MAX_ENTRIES 1024
+#define FILTER_MAX_COMMS 8
+
+struct comm_filter {
+	char prefix[16];
+	unsigned int len;
 };
 
 #endif
@@ -0,0 +1,80 @@
+#include "event_merge.h"
+#include <stdlib.h>
+
+
+struct event_merge *event_merge_init(void (*release)(const struct event *)) {
+	struct event_merge *em = (struct event_merge *)malloc(sizeof(struct event_merge));
+	em->release = release;
+	em->heap_capacity = 4096;
+	em->heap = (struct event *)malloc(em->heap_capacity * sizeof(struct event));
+	em->heap_size = 0;
+	em->watermark = 0;
+	em->next_watermark = 0;
+	em->released = 0;
+	em->num_late = 0;
+	return em;
+}
+
+void event_merge_push(struct event_merge *em, const struct event *e) {
+	if (e->seq < em->released) {
+		em->num_late++;
+	}
+	if (em->heap_size == em->heap_capacity) {
+		em->heap_capacity *= 2;
+		em->heap = (struct event *)realloc(em->heap, em->heap_capacity * sizeof(struct event));
+	}
+
+	unsigned long i = em->heap_size++;
+	while (i > 0) {
+		unsigned long parent = (i - 1) / 2;
+		if (em->heap[parent].seq <= e->seq) {
+			break;
+		}
+		em->heap[i] = em->heap[parent];
+		i = parent;
+	}
+	em->heap[i] = *e;
+
+	if (e->seq + 1 > em->next_watermark) {
+		em->next_watermark = e->seq + 1;
+	}
+}
+
+void event_merge_pop(struct event_merge *em) {
+	(*em->release)(&em->heap[0]);
+	if (em->heap[0].seq + 1 > em->released) {
+		em->released = em->heap[0].seq + 1;
+	}
+
+	struct event last = em->heap[--em->heap_size];
+	unsigned long i = 0;
+	for (;;) {
+		unsigned long child = 2 * i + 1;
+		if (child >= em->heap_size) {
+			break;
+		}
+		if (child + 1 < em->heap_size && em->heap[child + 1].seq < em->heap[child].seq) {
+			child++;
+		}
+		if (last.seq <= em->heap[child].seq) {
+			break;
+		}
+		em->heap[i] = em->heap[child];
+		i = child;
+	}
+	em->heap[i] = last;
+}
+
+void event_merge_end_round(struct event_merge *em) {
+	while (em->heap_size && em->heap[0].seq < em->watermark) {
+		event_merge_pop(em);
+	}
+	em->watermark = em->next_watermark;
+}
+
+// Releases everything that is left, at the end of the capture
+void event_merge_flush(struct event_merge *em) {
+	while (em->heap_size) {
+		event_merge_pop(em);
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef EVENT_MERGE_H
+#define EVENT_MERGE_H
+
+#include <stdbool.h>
+#include "common.h"
+
+
+/*
+ * Restores the global order of events read from per-CPU buffers. Each CPU's
+ * buffer is already in seq order, but a poll round reads the buffers one
+ * after the other, so events are held in a min-heap on seq. At the end of
+ * every round, the events up to the highest seq seen in the previous round
+ * are released: by then every CPU has had a full round to deliver anything
+ * older. Gaps left by dropped events are never waited on.
+ */
+struct event_merge {
+	// Called with each event as it is released, in seq order
+	void (*release)(const struct event *);
+	struct event *heap;
+	unsigned long heap_size;
+	unsigned long heap_capacity;
+	// Events below watermark can be released at the end of this round
+	unsigned long watermark;
+	// One past the highest seq seen so far
+	unsigned long next_watermark;
+	// One past the highest seq released
+	unsigned long released;
+	// Events that showed up after a later one had already been released
+	unsigned long num_late;
+};
+
+
+struct event_merge *event_merge_init(void (*release)(const struct event *));
+void event_merge_push(struct event_merge *em, const struct event *e);
+void event_merge_end_round(struct event_merge *em);
+void event_merge_flush(struct event_merge *em);
+
+#endif
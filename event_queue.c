@@ -0,0 +1,155 @@
+#include "event_queue.h"
+#include <stdlib.h>
+#include <utlist.h>
+
+
+void *event_queue_thread(void *arg) {
+	struct event_queue *eq = arg;
+
+	pthread_mutex_lock(&eq->lock);
+	for (;;) {
+		while (!eq->full && !eq->done) {
+			pthread_cond_wait(&eq->batch_ready, &eq->lock);
+		}
+		struct event_batch *batch = eq->full;
+		if (!batch) {
+			break;
+		}
+		DL_DELETE(eq->full, batch);
+		eq->num_queued--;
+		pthread_mutex_unlock(&eq->lock);
+
+		(*eq->consume)(eq->ctx, batch->events, batch->num_events);
+
+		pthread_mutex_lock(&eq->lock);
+		eq->num_consumed += batch->num_events;
+		batch->num_events = 0;
+		DL_APPEND(eq->free, batch);
+	}
+	pthread_mutex_unlock(&eq->lock);
+
+	return NULL;
+}
+
+struct event_batch *event_queue_get_batch(struct event_queue *eq) {
+	pthread_mutex_lock(&eq->lock);
+	struct event_batch *batch = eq->free;
+	if (batch) {
+		DL_DELETE(eq->free, batch);
+	} else {
+		eq->num_batches++;
+	}
+	pthread_mutex_unlock(&eq->lock);
+
+	if (!batch) {
+		batch = (struct event_batch *)malloc(sizeof(struct event_batch));
+		batch->num_events = 0;
+	}
+	return batch;
+}
+
+// Hands the current batch to the consumer thread, or drops its events if the
+// consumer is too far behind. Returns the batch to fill next.
+struct event_batch *event_queue_hand_off(struct event_queue *eq) {
+	pthread_mutex_lock(&eq->lock);
+	if (eq->max_queued && eq->num_queued >= eq->max_queued) {
+		eq->num_dropped += eq->current->num_events;
+		pthread_mutex_unlock(&eq->lock);
+		if (eq->on_drop) {
+			(*eq->on_drop)(eq->ctx, eq->current->events, eq->current->num_events);
+		}
+		eq->current->num_events = 0;
+		return eq->current;
+	}
+	DL_APPEND(eq->full, eq->current);
+	if (++eq->num_queued > eq->peak_queued) {
+		eq->peak_queued = eq->num_queued;
+	}
+	pthread_cond_signal(&eq->batch_ready);
+	pthread_mutex_unlock(&eq->lock);
+	return event_queue_get_batch(eq);
+}
+
+struct event_queue *event_queue_init(event_consumer_fn consume, void *ctx, unsigned long max_queued) {
+	struct event_queue *eq = (struct event_queue *)malloc(sizeof(struct event_queue));
+	eq->consume = consume;
+	eq->ctx = ctx;
+	eq->max_queued = max_queued;
+	eq->on_drop = NULL;
+	pthread_mutex_init(&eq->lock, NULL);
+	pthread_cond_init(&eq->batch_ready, NULL);
+	// utlist requires its lists to be initialized with NULL
+	eq->full = NULL;
+	eq->free = NULL;
+	eq->num_pushed = 0;
+	eq->done = false;
+	eq->num_consumed = 0;
+	eq->num_dropped = 0;
+	eq->num_batches = 0;
+	eq->num_queued = 0;
+	eq->peak_queued = 0;
+	eq->current = event_queue_get_batch(eq);
+	pthread_create(&eq->thread, NULL, event_queue_thread, eq);
+	return eq;
+}
+
+void event_queue_push(struct event_queue *eq, const struct event *e) {
+	eq->current->events[eq->current->num_events++] = *e;
+	eq->num_pushed++;
+	if (eq->current->num_events == EVENT_BATCH_SIZE) {
+		eq->current = event_queue_hand_off(eq);
+	}
+}
+
+// Hands over a partly filled batch, so a slow stream of events still reaches
+// the consumer. Called from the pushing thread.
+void event_queue_flush(struct event_queue *eq) {
+	if (eq->current->num_events) {
+		eq->current = event_queue_hand_off(eq);
+	}
+}
+
+unsigned long event_queue_consumed(struct event_queue *eq) {
+	pthread_mutex_lock(&eq->lock);
+	unsigned long num_consumed = eq->num_consumed;
+	pthread_mutex_unlock(&eq->lock);
+	return num_consumed;
+}
+
+unsigned long event_queue_dropped(struct event_queue *eq) {
+	pthread_mutex_lock(&eq->lock);
+	unsigned long num_dropped = eq->num_dropped;
+	pthread_mutex_unlock(&eq->lock);
+	return num_dropped;
+}
+
+// Consumes every pushed event and stops the consumer thread. The counters in
+// eq stay valid until event_queue_destroy.
+void event_queue_finish(struct event_queue *eq) {
+	pthread_mutex_lock(&eq->lock);
+	if (eq->current->num_events) {
+		// The tail of the capture is never dropped
+		DL_APPEND(eq->full, eq->current);
+		eq->num_queued++;
+	} else {
+		free(eq->current);
+	}
+	eq->current = NULL;
+	eq->done = true;
+	pthread_cond_signal(&eq->batch_ready);
+	pthread_mutex_unlock(&eq->lock);
+	pthread_join(eq->thread, NULL);
+
+	struct event_batch *batch = NULL;
+	struct event_batch *tmp = NULL;
+	DL_FOREACH_SAFE(eq->free, batch, tmp) {
+		DL_DELETE(eq->free, batch);
+		free(batch);
+	}
+}
+
+void event_queue_destroy(struct event_queue *eq) {
+	pthread_mutex_destroy(&eq->lock);
+	pthread_cond_destroy(&eq->batch_ready);
+	free(eq);
+}
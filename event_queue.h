@@ -0,0 +1,64 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "common.h"
+
+#define EVENT_BATCH_SIZE (64 * 1024)
+
+
+struct event_batch {
+	struct event events[EVENT_BATCH_SIZE];
+	unsigned long num_events;
+	struct event_batch *prev;
+	struct event_batch *next;
+};
+
+// Called on the consumer thread with each batch of events, in push order
+typedef void (*event_consumer_fn)(void *ctx, const struct event *events, unsigned long num_events);
+
+/*
+ * Moves work off the ring buffer callback. Events are copied into large
+ * in-memory batches, and a consumer thread hands each batch to consume once
+ * it fills up. Pushing never waits on the consumer. If it falls behind, more
+ * batches are allocated, up to max_queued waiting batches, after which new
+ * batches are dropped instead of stalling the callback and letting the ring
+ * buffer overflow.
+ */
+struct event_queue {
+	event_consumer_fn consume;
+	void *ctx;
+	// 0 for no limit
+	unsigned long max_queued;
+	// Called on the pushing thread with the events of each dropped batch, if set
+	event_consumer_fn on_drop;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t batch_ready;
+	// Filled batches, oldest first, and batches ready for reuse
+	struct event_batch *full;
+	struct event_batch *free;
+	// Only touched by the pushing thread
+	struct event_batch *current;
+	unsigned long num_pushed;
+	// The rest is protected by lock
+	bool done;
+	unsigned long num_consumed;
+	unsigned long num_dropped;
+	// Batches allocated, and the most that were ever waiting to be consumed
+	unsigned long num_batches;
+	unsigned long num_queued;
+	unsigned long peak_queued;
+};
+
+
+struct event_queue *event_queue_init(event_consumer_fn consume, void *ctx, unsigned long max_queued);
+void event_queue_push(struct event_queue *eq, const struct event *e);
+void event_queue_flush(struct event_queue *eq);
+unsigned long event_queue_consumed(struct event_queue *eq);
+unsigned long event_queue_dropped(struct event_queue *eq);
+void event_queue_finish(struct event_queue *eq);
+void event_queue_destroy(struct event_queue *eq);
+
+#endif
@@ -0,0 +1,168 @@
+#include "folio_table.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+void folio_table_init(struct folio_table *ft) {
+	memset(ft, 0, sizeof(struct folio_table));
+	ft->free_slots = SLOT_NONE;
+	ft->index_mask = 2 * FOLIO_TABLE_MIN_SLOTS - 1;
+	ft->index = (uint32_t *)malloc((ft->index_mask + 1) * sizeof(uint32_t));
+	memset(ft->index, 0xff, (ft->index_mask + 1) * sizeof(uint32_t));
+}
+
+// Doubles the slot arrays. Slots are indices, so nothing pointing into the
+// arrays has to be fixed up after they move.
+void folio_table_grow_slots(struct folio_table *ft) {
+	uint32_t num_slots = ft->num_slots ? 2 * ft->num_slots : FOLIO_TABLE_MIN_SLOTS;
+	ft->folios = (unsigned long *)realloc(ft->folios, num_slots * sizeof(unsigned long));
+	ft->prev = (uint32_t *)realloc(ft->prev, num_slots * sizeof(uint32_t));
+	ft->next = (uint32_t *)realloc(ft->next, num_slots * sizeof(uint32_t));
+	ft->values = (uint32_t *)realloc(ft->values, num_slots * sizeof(uint32_t));
+	// Chain the new slots into the free list, lowest first
+	for (uint32_t slot = num_slots; slot-- > ft->num_slots;) {
+		ft->next[slot] = ft->free_slots;
+		ft->free_slots = slot;
+	}
+	ft->num_slots = num_slots;
+}
+
+void folio_table_index_insert(struct folio_table *ft, uint32_t slot) {
+	unsigned long i = folio_table_hash(ft->folios[slot]) & ft->index_mask;
+	while (ft->index[i] != SLOT_NONE) {
+		i = (i + 1) & ft->index_mask;
+	}
+	ft->index[i] = slot;
+}
+
+void folio_table_grow_index(struct folio_table *ft) {
+	uint32_t *old_index = ft->index;
+	unsigned long old_size = ft->index_mask + 1;
+	ft->index_mask = 2 * old_size - 1;
+	ft->index = (uint32_t *)malloc(2 * old_size * sizeof(uint32_t));
+	memset(ft->index, 0xff, 2 * old_size * sizeof(uint32_t));
+	for (unsigned long i = 0; i < old_size; i++) {
+		if (old_index[i] != SLOT_NONE) {
+			folio_table_index_insert(ft, old_index[i]);
+		}
+	}
+	free(old_index);
+}
+
+// Adds folio, which must not be in the table yet, and returns its slot. The
+// slot's value is 0 and it isn't linked into any list.
+uint32_t folio_table_add(struct folio_table *ft, unsigned long folio) {
+	if (ft->free_slots == SLOT_NONE) {
+		folio_table_grow_slots(ft);
+	}
+	if (2 * (unsigned long)(ft->size + 1) > ft->index_mask + 1) {
+		folio_table_grow_index(ft);
+	}
+
+	uint32_t slot = ft->free_slots;
+	ft->free_slots = ft->next[slot];
+	ft->folios[slot] = folio;
+	ft->values[slot] = 0;
+	ft->size++;
+	folio_table_index_insert(ft, slot);
+	return slot;
+}
+
+// Frees slot, which must already be unlinked from its list. Later entries of
+// its probe run are shifted back over it, so the index never needs tombstones.
+void folio_table_remove(struct folio_table *ft, uint32_t slot) {
+	unsigned long i = folio_table_hash(ft->folios[slot]) & ft->index_mask;
+	while (ft->index[i] != slot) {
+		i = (i + 1) & ft->index_mask;
+	}
+	unsigned long j = i;
+	for (;;) {
+		j = (j + 1) & ft->index_mask;
+		if (ft->index[j] == SLOT_NONE) {
+			break;
+		}
+		// An entry can fill the hole unless its home lies cyclically in (i, j]
+		unsigned long home = folio_table_hash(ft->folios[ft->index[j]]) & ft->index_mask;
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+			ft->index[i] = ft->index[j];
+			i = j;
+		}
+	}
+	ft->index[i] = SLOT_NONE;
+
+	ft->next[slot] = ft->free_slots;
+	ft->free_slots = slot;
+	ft->size--;
+}
+
+void folio_table_destroy(struct folio_table *ft) {
+	free(ft->folios);
+	free(ft->prev);
+	free(ft->next);
+	free(ft->values);
+	free(ft->index);
+}
+
+// Saves the slot arrays as they are, so slot numbers held by lists and
+// policies stay valid. The index is rebuilt on load instead.
+void folio_table_save(const struct folio_table *ft, struct checkpoint *c) {
+	checkpoint_write(c, &ft->size, sizeof(ft->size));
+	checkpoint_write(c, &ft->free_slots, sizeof(ft->free_slots));
+	checkpoint_write_array(c, ft->folios, sizeof(unsigned long), ft->num_slots);
+	checkpoint_write_array(c, ft->prev, sizeof(uint32_t), ft->num_slots);
+	checkpoint_write_array(c, ft->next, sizeof(uint32_t), ft->num_slots);
+	checkpoint_write_array(c, ft->values, sizeof(uint32_t), ft->num_slots);
+}
+
+// Replaces the contents of ft, which must be initialized, with a saved table
+void folio_table_load(struct folio_table *ft, struct checkpoint *c) {
+	uint64_t counts[4];
+	folio_table_destroy(ft);
+	folio_table_init(ft);
+	checkpoint_read(c, &ft->size, sizeof(ft->size));
+	checkpoint_read(c, &ft->free_slots, sizeof(ft->free_slots));
+	ft->folios = (unsigned long *)checkpoint_read_array(c, sizeof(unsigned long), &counts[0]);
+	ft->prev = (uint32_t *)checkpoint_read_array(c, sizeof(uint32_t), &counts[1]);
+	ft->next = (uint32_t *)checkpoint_read_array(c, sizeof(uint32_t), &counts[2]);
+	ft->values = (uint32_t *)checkpoint_read_array(c, sizeof(uint32_t), &counts[3]);
+	ft->num_slots = counts[0];
+	if (counts[1] != counts[0] || counts[2] != counts[0] || counts[3] != counts[0] || ft->size > ft->num_slots) {
+		c->failed = 1;
+	}
+	if (c->failed) {
+		folio_table_destroy(ft);
+		folio_table_init(ft);
+		return;
+	}
+
+	// Every slot off the free list is in use
+	char *free_slot = (char *)calloc(ft->num_slots ? ft->num_slots : 1, 1);
+	uint32_t num_free = 0;
+	for (uint32_t slot = ft->free_slots; slot != SLOT_NONE && num_free <= ft->num_slots; slot = ft->next[slot]) {
+		if (slot >= ft->num_slots) {
+			num_free = UINT32_MAX;
+			break;
+		}
+		free_slot[slot] = 1;
+		num_free++;
+	}
+	if (num_free != ft->num_slots - ft->size) {
+		c->failed = 1;
+		free(free_slot);
+		folio_table_destroy(ft);
+		folio_table_init(ft);
+		return;
+	}
+	while (2 * (unsigned long)ft->size > ft->index_mask + 1) {
+		ft->index_mask = 2 * ft->index_mask + 1;
+	}
+	free(ft->index);
+	ft->index = (uint32_t *)malloc((ft->index_mask + 1) * sizeof(uint32_t));
+	memset(ft->index, 0xff, (ft->index_mask + 1) * sizeof(uint32_t));
+	for (uint32_t slot = 0; slot < ft->num_slots; slot++) {
+		if (!free_slot[slot]) {
+			folio_table_index_insert(ft, slot);
+		}
+	}
+	free(free_slot);
+}
@@ -0,0 +1,121 @@
+#ifndef FOLIO_TABLE_H
+#define FOLIO_TABLE_H
+
+#include <stdint.h>
+#include "checkpoint.h"
+
+// The slot number that stands for no slot, e.g. the end of a list
+#define SLOT_NONE UINT32_MAX
+#define FOLIO_TABLE_MIN_SLOTS 1024
+
+
+/*
+ * Folios tracked by a simulation, stored as a struct of arrays indexed by
+ * 32-bit slot numbers instead of one heap node per folio. Slots link into
+ * doubly linked lists through prev and next, and values holds whatever a
+ * policy keeps per folio. An open-addressing index maps folios to slots.
+ * A tracked folio costs 20 bytes of arrays plus 8 to 16 bytes of index, and
+ * following a link only touches the 4-byte prev and next arrays.
+ */
+struct folio_table {
+	unsigned long *folios;
+	uint32_t *prev;
+	uint32_t *next;
+	uint32_t *values;
+	// Slots allocated in the arrays above, and slots in use
+	uint32_t num_slots;
+	uint32_t size;
+	// Unused slots, chained through next
+	uint32_t free_slots;
+	// Linear probing table of slots, SLOT_NONE where empty. It is kept at most
+	// half full, so lookups rarely go past one cache line.
+	uint32_t *index;
+	unsigned long index_mask;
+};
+
+
+void folio_table_init(struct folio_table *ft);
+uint32_t folio_table_add(struct folio_table *ft, unsigned long folio);
+void folio_table_remove(struct folio_table *ft, uint32_t slot);
+void folio_table_destroy(struct folio_table *ft);
+void folio_table_save(const struct folio_table *ft, struct checkpoint *c);
+void folio_table_load(struct folio_table *ft, struct checkpoint *c);
+
+// Folio pointers are 64-byte aligned, so the hash has to mix in the high bits
+static inline unsigned long folio_table_hash(unsigned long folio) {
+	return (folio * 0x9e3779b97f4a7c15UL) >> 32;
+}
+
+// Returns the slot of folio, SLOT_NONE if it isn't in the table
+static inline uint32_t folio_table_find(const struct folio_table *ft, unsigned long folio) {
+	unsigned long i = folio_table_hash(folio) & ft->index_mask;
+	for (;;) {
+		uint32_t slot = ft->index[i];
+		if (slot == SLOT_NONE || ft->folios[slot] == folio) {
+			return slot;
+		}
+		i = (i + 1) & ft->index_mask;
+	}
+}
+
+/*
+ * Lists of slots, linked through a prev and a next array. As in utlist, the
+ * head's prev is the tail, so appending is O(1), and the tail's next is
+ * SLOT_NONE. head is SLOT_NONE for an empty list.
+ */
+
+static inline void slot_list_append(uint32_t *prev, uint32_t *next, uint32_t *head, uint32_t slot) {
+	next[slot] = SLOT_NONE;
+	if (*head == SLOT_NONE) {
+		prev[slot] = slot;
+		*head = slot;
+	} else {
+		prev[slot] = prev[*head];
+		next[prev[*head]] = slot;
+		prev[*head] = slot;
+	}
+}
+
+static inline void slot_list_prepend(uint32_t *prev, uint32_t *next, uint32_t *head, uint32_t slot) {
+	if (*head == SLOT_NONE) {
+		prev[slot] = slot;
+		next[slot] = SLOT_NONE;
+	} else {
+		prev[slot] = prev[*head];
+		next[slot] = *head;
+		prev[*head] = slot;
+	}
+	*head = slot;
+}
+
+// Links slot in right before before, or at the tail if before is SLOT_NONE
+static inline void slot_list_insert_before(uint32_t *prev, uint32_t *next, uint32_t *head, uint32_t before, uint32_t slot) {
+	if (before == SLOT_NONE) {
+		slot_list_append(prev, next, head, slot);
+	} else if (before == *head) {
+		slot_list_prepend(prev, next, head, slot);
+	} else {
+		prev[slot] = prev[before];
+		next[slot] = before;
+		next[prev[before]] = slot;
+		prev[before] = slot;
+	}
+}
+
+static inline void slot_list_delete(uint32_t *prev, uint32_t *next, uint32_t *head, uint32_t slot) {
+	if (prev[slot] == slot) {
+		*head = SLOT_NONE;
+	} else if (slot == *head) {
+		prev[next[slot]] = prev[slot];
+		*head = next[slot];
+	} else {
+		next[prev[slot]] = next[slot];
+		if (next[slot] != SLOT_NONE) {
+			prev[next[slot]] = prev[slot];
+		} else {
+			prev[*head] = prev[slot];
+		}
+	}
+}
+
+#endif
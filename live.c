@@ -0,0 +1,76 @@
+#include "live.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct live_simulation *live_init(const struct policy **pols, int num_policies, const unsigned long *capacities, int num_capacities, double interval) {
+	struct live_simulation *live = (struct live_simulation *)malloc(sizeof(struct live_simulation));
+	live->num_policies = num_policies;
+	live->num_capacities = num_capacities;
+	memcpy(live->capacities, capacities, num_capacities * sizeof(unsigned long));
+
+	// Laid out like the simulator's: num_policies simulations per capacity
+	int caches = num_capacities ? num_capacities : 1;
+	live->sims = (struct policy_simulation **)malloc(caches * num_policies * sizeof(struct policy_simulation *));
+	for (int c = 0; c < caches; c++) {
+		for (int i = 0; i < num_policies; i++) {
+			live->sims[c * num_policies + i] = policy_simulation_init(pols[i], num_capacities ? capacities[c] : 0);
+		}
+	}
+
+	live->ls = linux_stats_init();
+	live->interval = interval;
+	clock_gettime(CLOCK_MONOTONIC, &live->last_print);
+	live->num_events = 0;
+	live->batch = (struct event *)malloc(EVENT_BATCH_SIZE * sizeof(struct event));
+	live->queue = NULL;
+	pthread_mutex_init(&live->print_lock, NULL);
+	return live;
+}
+
+// event_queue consumer, runs on the queue's thread
+void live_consume(void *ctx, const struct event *events, unsigned long num_events) {
+	struct live_simulation *live = ctx;
+	int num_sims = live->num_policies * (live->num_capacities ? live->num_capacities : 1);
+
+	unsigned int max_task_id = 0;
+	for (unsigned long i = 0; i < num_events; i++) {
+		struct event *e = &live->batch[i];
+		*e = events[i];
+		linux_stats_track(live->ls, e);
+		if (e->type != SFL && e->task_id > max_task_id) {
+			max_task_id = e->task_id;
+		}
+	}
+	for (int s = 0; s < num_sims; s++) {
+		policy_simulation_track_accesses(live->sims[s], live->batch, num_events, max_task_id);
+	}
+	live->num_events += num_events;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = (now.tv_sec - live->last_print.tv_sec) + (now.tv_nsec - live->last_print.tv_nsec) / 1e9;
+	if (elapsed >= live->interval) {
+		live_print(live);
+		live->last_print = now;
+	}
+}
+
+// Only safe on the consumer thread, or once the queue is finished
+void live_print(struct live_simulation *live) {
+	pthread_mutex_lock(&live->print_lock);
+	printf("\n");
+	printf("%-16s    %lu\n", "Events", live->num_events);
+	unsigned long num_skipped = live->queue ? event_queue_dropped(live->queue) : 0;
+	if (num_skipped) {
+		printf("%-16s    %lu\n", "Events Skipped", num_skipped);
+	}
+	if (live->num_capacities) {
+		report_print_capacity_table(live->sims, live->num_policies, live->capacities, live->num_capacities, NULL, live->ls);
+	} else {
+		report_print_task_table(live->sims, live->num_policies, NULL, live->ls);
+	}
+	fflush(stdout);
+	pthread_mutex_unlock(&live->print_lock);
+}
@@ -0,0 +1,45 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <time.h>
+#include <pthread.h>
+#include "common.h"
+#include "policy_simulation.h"
+#include "report.h"
+#include "event_queue.h"
+
+// Batches the live simulation may fall behind by before events are skipped
+#define LIVE_MAX_QUEUED 16
+
+
+/*
+ * Runs policy simulations on the profiler's events as they arrive, as the
+ * consumer of an event_queue, and prints the same tables as the simulator
+ * every interval seconds. With no capacities, each policy gets one unbounded
+ * cache that replays the recorded evictions.
+ */
+struct live_simulation {
+	struct policy_simulation **sims;
+	int num_policies;
+	unsigned long capacities[MAX_CAPACITIES];
+	int num_capacities;
+	struct linux_stats *ls;
+	double interval;
+	struct timespec last_print;
+	unsigned long num_events;
+	// The batch being consumed, with task ids resolved once for every simulation
+	struct event *batch;
+	// The queue feeding the simulation, set by the profiler before the first
+	// push, to report the events it had to skip
+	struct event_queue *queue;
+	// Held while the tables are printed. The profiler takes it around its
+	// progress line too, so the two never interleave on stdout.
+	pthread_mutex_t print_lock;
+};
+
+
+struct live_simulation *live_init(const struct policy **pols, int num_policies, const unsigned long *capacities, int num_capacities, double interval);
+void live_consume(void *ctx, const struct event *events, unsigned long num_events);
+void live_print(struct live_simulation *live);
+
+#endif
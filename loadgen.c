@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define PAGE_SIZE 4096
+#define READ_SIZE (1 << 20)
+
+
+struct loadgen_opts {
+	const char *dir;
+	int num_files;
+	unsigned long file_size;
+	int seconds;
+	int num_threads;
+	bool e;
+};
+
+struct loadgen_worker_args {
+	struct loadgen_opts *flags;
+	int id;
+	// Pages read so far, sampled by the main thread
+	volatile unsigned long pages;
+};
+
+
+volatile bool done;
+
+
+// Parses a byte count with an optional K, M or G suffix. Returns 0 on failure.
+unsigned long parse_size(const char *str) {
+	char *end;
+	unsigned long size = strtoul(str, &end, 10);
+	switch (*end) {
+		case 'G':
+			size <<= 10;
+		case 'M':
+			size <<= 10;
+		case 'K':
+			size <<= 10;
+			end++;
+			break;
+	}
+	return *end ? 0 : size;
+}
+
+void file_path(struct loadgen_opts *flags, int i, char *path, size_t size) {
+	snprintf(path, size, "%s/file%d", flags->dir, i);
+}
+
+// Creates any file in the set that is missing or too small
+int create_files(struct loadgen_opts *flags) {
+	char path[4096];
+	char *buf = (char *)malloc(READ_SIZE);
+	memset(buf, 0xab, READ_SIZE);
+	mkdir(flags->dir, 0755);
+
+	for (int i = 0; i < flags->num_files; i++) {
+		struct stat st;
+		file_path(flags, i, path, sizeof(path));
+		if (!stat(path, &st) && st.st_size >= flags->file_size) {
+			continue;
+		}
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			printf("Failed to create %s\n", path);
+			free(buf);
+			return 0;
+		}
+		for (unsigned long written = 0; written < flags->file_size; written += READ_SIZE) {
+			unsigned long n = flags->file_size - written < READ_SIZE ? flags->file_size - written : READ_SIZE;
+			if (write(fd, buf, n) != n) {
+				printf("Failed to write %s\n", path);
+				close(fd);
+				free(buf);
+				return 0;
+			}
+		}
+		close(fd);
+	}
+
+	free(buf);
+	return 1;
+}
+
+// Streams through the file set, starting at a different file in each worker
+void *loadgen_worker(void *arg) {
+	struct loadgen_worker_args *args = arg;
+	struct loadgen_opts *flags = args->flags;
+	char path[4096];
+	char *buf = (char *)malloc(READ_SIZE);
+
+	for (int i = args->id; !done; i++) {
+		file_path(flags, i % flags->num_files, path, sizeof(path));
+		int fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			break;
+		}
+		ssize_t n;
+		while (!done && (n = read(fd, buf, READ_SIZE)) > 0) {
+			args->pages += (n + PAGE_SIZE - 1) / PAGE_SIZE;
+		}
+		if (flags->e) {
+			// Drop the file from the page cache so the next pass misses
+			posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		}
+		close(fd);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	struct loadgen_opts flags;
+	flags.dir = "loadgen.d";
+	flags.num_files = 64;
+	flags.file_size = 16UL << 20;
+	flags.seconds = 10;
+	flags.num_threads = 1;
+	flags.e = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "d:f:s:t:j:e")) != -1) {
+		switch(opt) {
+			case 'd':
+				flags.dir = optarg;
+				break;
+			case 'f':
+				flags.num_files = atoi(optarg);
+				break;
+			case 's':
+				flags.file_size = parse_size(optarg);
+				break;
+			case 't':
+				flags.seconds = atoi(optarg);
+				break;
+			case 'j':
+				flags.num_threads = atoi(optarg);
+				break;
+			case 'e':
+				flags.e = true;
+				break;
+			case '?':
+				printf("Usage: %s [-d dir] [-f files] [-s file_size] [-t seconds] [-j threads] [-e]\n", argv[0]);
+				printf("-d: Directory holding the file set, created if missing (default loadgen.d)\n");
+				printf("-f: Number of files in the set (default 64)\n");
+				printf("-s: Size of each file in bytes, with an optional K, M or G suffix (default 16M)\n");
+				printf("-t: Seconds to run for (default 10)\n");
+				printf("-j: Number of reader threads (default 1)\n");
+				printf("-e: Evict each file from the page cache after reading it, so every read misses\n");
+				return 1;
+		}
+	}
+	if (flags.num_files <= 0 || !flags.file_size || flags.seconds <= 0 || flags.num_threads <= 0) {
+		printf("Invalid arguments\n");
+		return 1;
+	}
+
+	if (!create_files(&flags)) {
+		return 1;
+	}
+
+	pthread_t *threads = (pthread_t *)malloc(flags.num_threads * sizeof(pthread_t));
+	struct loadgen_worker_args *args = (struct loadgen_worker_args *)calloc(flags.num_threads, sizeof(struct loadgen_worker_args));
+	done = false;
+	for (int i = 0; i < flags.num_threads; i++) {
+		args[i].flags = &flags;
+		args[i].id = i;
+		pthread_create(&threads[i], NULL, loadgen_worker, &args[i]);
+	}
+
+	unsigned long last_pages = 0;
+	unsigned long pages = 0;
+	for (int s = 0; s < flags.seconds; s++) {
+		sleep(1);
+		pages = 0;
+		for (int i = 0; i < flags.num_threads; i++) {
+			pages += args[i].pages;
+		}
+		printf("Pages Read: %-16lu Rate: %-12lu pages/sec\r", pages, pages - last_pages);
+		fflush(stdout);
+		last_pages = pages;
+	}
+	done = true;
+	for (int i = 0; i < flags.num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	printf("\n");
+	printf("Pages Read: %lu in %ds (%lu pages/sec)\n", pages, flags.seconds, pages / flags.seconds);
+	free(args);
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include "next_use.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+struct next_use *next_use_init(void) {
+	struct next_use *nu = (struct next_use *)malloc(sizeof(struct next_use));
+	nu->size = 1 << 16;
+	nu->distances = (uint32_t *)malloc(nu->size * sizeof(uint32_t));
+	nu->num_events = 0;
+	nu->fd = -1;
+	// uthash requires its hash tables to be initialized with NULL
+	nu->last_access = NULL;
+	return nu;
+}
+
+// Maps the first size entries of the backing file
+static uint32_t *next_use_map(struct next_use *nu, unsigned long size) {
+	if (ftruncate(nu->fd, size * sizeof(uint32_t))) {
+		return NULL;
+	}
+	uint32_t *distances = mmap(NULL, size * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED, nu->fd, 0);
+	return distances == MAP_FAILED ? NULL : distances;
+}
+
+static void next_use_grow(struct next_use *nu) {
+	unsigned long size = nu->size * 2;
+
+	if (nu->fd < 0 && size > NEXT_USE_MEMORY_EVENTS) {
+		FILE *file = tmpfile();
+		if (file) {
+			nu->fd = dup(fileno(file));
+			fclose(file);
+			uint32_t *distances = nu->fd >= 0 ? next_use_map(nu, size) : NULL;
+			if (distances) {
+				memcpy(distances, nu->distances, nu->num_events * sizeof(uint32_t));
+				free(nu->distances);
+				nu->distances = distances;
+				nu->size = size;
+				return;
+			}
+			if (nu->fd >= 0) {
+				close(nu->fd);
+			}
+			nu->fd = -1;
+		}
+		fprintf(stderr, "Warning: failed to spill the next use index to a file, keeping it in memory\n");
+	}
+
+	if (nu->fd < 0) {
+		nu->distances = (uint32_t *)realloc(nu->distances, size * sizeof(uint32_t));
+	} else {
+		// The file keeps the contents, so the old mapping can just be dropped
+		munmap(nu->distances, nu->size * sizeof(uint32_t));
+		nu->distances = next_use_map(nu, size);
+		if (!nu->distances) {
+			fprintf(stderr, "Failed to grow the next use index\n");
+			exit(1);
+		}
+	}
+	nu->size = size;
+}
+
+// Called on every event of the trace, in order
+void next_use_track(struct next_use *nu, const struct event *e) {
+	if (nu->num_events == nu->size) {
+		next_use_grow(nu);
+	}
+	unsigned long pos = nu->num_events++;
+	nu->distances[pos] = 0;
+	if (e->type == SFL) {
+		return;
+	}
+
+	struct next_use_entry *nue = NULL;
+	HASH_FIND(hh, nu->last_access, &e->folio, sizeof(unsigned long), nue);
+	if (nue) {
+		unsigned long distance = pos - nue->last;
+		nu->distances[nue->last] = distance < UINT32_MAX ? distance : UINT32_MAX;
+	} else {
+		nue = (struct next_use_entry *)malloc(sizeof(struct next_use_entry));
+		nue->folio = e->folio;
+		HASH_ADD(hh, nu->last_access, folio, sizeof(unsigned long), nue);
+	}
+	nue->last = pos;
+}
+
+// Frees what was only needed to build the index
+void next_use_finish(struct next_use *nu) {
+	struct next_use_entry *nue, *tmp;
+	HASH_ITER(hh, nu->last_access, nue, tmp) {
+		HASH_DEL(nu->last_access, nue);
+		free(nue);
+	}
+}
+
+// Position of the next access to the folio accessed at pos, ULONG_MAX if there is none
+unsigned long next_use_get(const struct next_use *nu, unsigned long pos) {
+	if (pos >= nu->num_events || !nu->distances[pos]) {
+		return ULONG_MAX;
+	}
+	return pos + nu->distances[pos];
+}
@@ -0,0 +1,44 @@
+#ifndef NEXT_USE_H
+#define NEXT_USE_H
+
+#include <stdint.h>
+#include <uthash.h>
+#include "common.h"
+
+// Past this many events the index moves from the heap to a temporary file,
+// so the kernel can write it out instead of holding it all in memory
+#define NEXT_USE_MEMORY_EVENTS (1UL << 26)
+
+
+struct next_use_entry {
+	unsigned long folio;
+	// Position of the folio's most recent access
+	unsigned long last;
+	UT_hash_handle hh;
+};
+
+/*
+ * For every event of a trace, the position of the next access to the same
+ * folio. Positions count every event, SFLs included, and are what the
+ * simulator puts in event seq. Built in one pass over the trace: each access
+ * fills in the distance of the folio's previous access.
+ */
+struct next_use {
+	// distances[pos] is how far ahead the next access is, 0 if there is none.
+	// Distances past UINT32_MAX are clamped to it.
+	uint32_t *distances;
+	unsigned long num_events;
+	unsigned long size;
+	// Temporary file backing distances, -1 while it is on the heap
+	int fd;
+	// Only needed while the index is built
+	struct next_use_entry *last_access;
+};
+
+
+struct next_use *next_use_init(void);
+void next_use_track(struct next_use *nu, const struct event *e);
+void next_use_finish(struct next_use *nu);
+unsigned long next_use_get(const struct next_use *nu, unsigned long pos);
+
+#endif
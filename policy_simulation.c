@@ -1,65 +1,201 @@
 #include "policy_simulation.h"
 #include <stdio.h>
-#include <utlist.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
 
 
-struct policy_simulation *policy_simulation_init(void (*hit_update)(struct policy_simulation *, struct list_entry *), void (*miss_update)(struct policy_simulation *, unsigned long)) {
+// Shorthands for the list of resident slots
+static inline void list_append(struct policy_simulation *ps, uint32_t slot) {
+	slot_list_append(ps->entries.prev, ps->entries.next, &ps->list_head, slot);
+}
+
+static inline void list_prepend(struct policy_simulation *ps, uint32_t slot) {
+	slot_list_prepend(ps->entries.prev, ps->entries.next, &ps->list_head, slot);
+}
+
+static inline void list_insert_before(struct policy_simulation *ps, uint32_t before, uint32_t slot) {
+	slot_list_insert_before(ps->entries.prev, ps->entries.next, &ps->list_head, before, slot);
+}
+
+static inline void list_delete(struct policy_simulation *ps, uint32_t slot) {
+	slot_list_delete(ps->entries.prev, ps->entries.next, &ps->list_head, slot);
+}
+
+struct policy_simulation *policy_simulation_init(const struct policy *policy, unsigned long capacity) {
 	struct policy_simulation *ps = (struct policy_simulation *)malloc(sizeof(struct policy_simulation));
 
-	// uthash requires its lists and hash tables to be initialized with NULL
-	ps->list_head = NULL;
+	folio_table_init(&ps->entries);
+	ps->list_head = SLOT_NONE;
 	ps->task_stats = NULL;
-	ps->hit_update = hit_update;
-	ps->miss_update = miss_update;
+	ps->num_task_stats = 0;
+	ps->policy = policy;
+	ps->policy_data = NULL;
+	ps->capacity = capacity;
 	ps->hits = 0;
 	ps->misses = 0;
+	ps->event = NULL;
 
 	return ps;
 }
 
-void policy_simulation_track_access(struct policy_simulation *ps, const struct event *e) {
-	if (e->type == SFL) {
-		policy_simulation_evict(ps, e->num_evicted);
+// Allocates a slot for folio and adds it to the index. The caller is
+// responsible for linking it into list_head.
+uint32_t policy_simulation_new_entry(struct policy_simulation *ps, unsigned long folio) {
+	return folio_table_add(&ps->entries, folio);
+}
+
+// Removes a slot that is no longer in list_head from the index and frees it
+void policy_simulation_free_entry(struct policy_simulation *ps, uint32_t slot) {
+	folio_table_remove(&ps->entries, slot);
+}
+
+// Grows task_stats to cover every task id up to max_task_id
+void policy_simulation_reserve_tasks(struct policy_simulation *ps, unsigned int max_task_id) {
+	if (max_task_id < ps->num_task_stats) {
 		return;
 	}
+	unsigned int num_task_stats = ps->num_task_stats ? ps->num_task_stats : 64;
+	while (max_task_id >= num_task_stats) {
+		num_task_stats *= 2;
+	}
+	ps->task_stats = (struct task_stats *)realloc(ps->task_stats, num_task_stats * sizeof(struct task_stats));
+	memset(ps->task_stats + ps->num_task_stats, 0, (num_task_stats - ps->num_task_stats) * sizeof(struct task_stats));
+	ps->num_task_stats = num_task_stats;
+}
+
+// Unlinks and frees del_slot, see track_access_inline for the hooks
+static inline __attribute__((always_inline)) void remove_entry_inline(struct policy_simulation *ps, uint32_t del_slot,
+		void (*evict_update)(struct policy_simulation *, uint32_t)) {
+	if (evict_update) {
+		(*evict_update)(ps, del_slot);
+	}
+	list_delete(ps, del_slot);
+	policy_simulation_free_entry(ps, del_slot);
+}
 
-	struct task_stats_entry *tse = NULL;
-	HASH_FIND(hh, ps->task_stats, &e->key, sizeof(struct task_key), tse);
-	if (!tse) {
-		tse = (struct task_stats_entry *)malloc(sizeof(struct task_stats_entry));
-		tse->key = e->key;
-		tse->hits = 0;
-		tse->misses = 0;
-		HASH_ADD(hh, ps->task_stats, key, sizeof(struct task_key), tse);
+/*
+ * The replay of one access, written once for every policy. The hooks are
+ * parameters so that POLICY below can pass its policy's functions as
+ * constants: the calls become direct, small hooks are inlined and the
+ * branches on NULL hooks fold away. The generic path passes ps->policy's
+ * hooks instead. task_stats must already cover e->task_id.
+ */
+static inline __attribute__((always_inline)) void track_access_inline(struct policy_simulation *ps, const struct event *e,
+		void (*hit_update)(struct policy_simulation *, uint32_t),
+		void (*miss_update)(struct policy_simulation *, unsigned long),
+		void (*repeat_update)(struct policy_simulation *, uint32_t, unsigned long),
+		void (*evict_update)(struct policy_simulation *, uint32_t),
+		uint32_t (*victim)(struct policy_simulation *)) {
+	// Evictions outside of track_access see no event
+	ps->event = e;
+	if (e->type == SFL) {
+		// A fixed capacity replaces the memory pressure recorded in the trace
+		if (!ps->capacity) {
+			policy_simulation_evict(ps, e->num_evicted);
+		}
+		ps->event = NULL;
+		return;
 	}
 
-	struct list_entry *entry = NULL;
-	DL_SEARCH_SCALAR(ps->list_head, entry, folio, e->folio);
-	if (entry) {
+	struct task_stats *tse = &ps->task_stats[e->task_id];
+
+	// A weighted access is one access followed by count - 1 hits on the same folio
+	unsigned long repeats = e->count > 1 ? e->count - 1 : 0;
+	ps->hits += repeats;
+	tse->hits += repeats;
+
+	uint32_t slot = folio_table_find(&ps->entries, e->folio);
+	if (slot != SLOT_NONE) {
 		ps->hits++;
 		tse->hits++;
-		(*ps->hit_update)(ps, entry);
+		(*hit_update)(ps, slot);
 	} else {
 		ps->misses++;
 		tse->misses++;
-		(*ps->miss_update)(ps, e->folio);
+		if (ps->capacity && ps->entries.size >= ps->capacity) {
+			remove_entry_inline(ps, victim ? (*victim)(ps) : ps->list_head, evict_update);
+		}
+		(*miss_update)(ps, e->folio);
+		if (repeats && repeat_update) {
+			slot = folio_table_find(&ps->entries, e->folio);
+		}
+	}
+	if (repeats && repeat_update) {
+		(*repeat_update)(ps, slot, repeats);
+	}
+	ps->event = NULL;
+}
+
+// The dynamic path, for policies built without POLICY, such as plugins
+void policy_simulation_track_access(struct policy_simulation *ps, const struct event *e) {
+	const struct policy *p = ps->policy;
+	if (e->type != SFL) {
+		policy_simulation_reserve_tasks(ps, e->task_id);
+	}
+	track_access_inline(ps, e, p->hit_update, p->miss_update, p->repeat_update, p->evict_update, p->victim);
+}
+
+// Replays a run of accesses, where max_task_id is at least the task id of
+// every one but SFL events. Policies defined with POLICY replay it in a loop
+// specialized for them.
+void policy_simulation_track_accesses(struct policy_simulation *ps, const struct event *events, unsigned long num_events, unsigned int max_task_id) {
+	if (!num_events) {
+		return;
+	}
+	policy_simulation_reserve_tasks(ps, max_task_id);
+	const struct policy *p = ps->policy;
+	if (p->track_accesses) {
+		(*p->track_accesses)(ps, events, num_events);
+		return;
+	}
+	for (unsigned long i = 0; i < num_events; i++) {
+		track_access_inline(ps, &events[i], p->hit_update, p->miss_update, p->repeat_update, p->evict_update, p->victim);
 	}
 }
 
-// We evict from the head of the list
+void policy_simulation_remove_entry(struct policy_simulation *ps, uint32_t del_slot) {
+	remove_entry_inline(ps, del_slot, ps->policy->evict_update);
+}
+
+// Drops folio from the cache if it is resident, without counting it as an eviction
+void policy_simulation_remove(struct policy_simulation *ps, unsigned long folio) {
+	uint32_t slot = folio_table_find(&ps->entries, folio);
+	if (slot != SLOT_NONE) {
+		policy_simulation_remove_entry(ps, slot);
+	}
+}
+
+// Changes the capacity of a fixed-capacity cache, evicting down to it if it shrank
+void policy_simulation_set_capacity(struct policy_simulation *ps, unsigned long capacity) {
+	ps->capacity = capacity;
+	while (policy_simulation_size(ps) > capacity) {
+		policy_simulation_evict_one(ps);
+	}
+}
+
+// Multiplies every hit and miss count by factor
+void policy_simulation_scale_counts(struct policy_simulation *ps, double factor) {
+	ps->hits = ps->hits * factor + 0.5;
+	ps->misses = ps->misses * factor + 0.5;
+	for (unsigned int i = 0; i < ps->num_task_stats; i++) {
+		ps->task_stats[i].hits = ps->task_stats[i].hits * factor + 0.5;
+		ps->task_stats[i].misses = ps->task_stats[i].misses * factor + 0.5;
+	}
+}
+
+// We evict from the head of the list, unless the policy picks another slot
+void policy_simulation_evict_one(struct policy_simulation *ps) {
+	uint32_t victim = ps->policy->victim ? (*ps->policy->victim)(ps) : ps->list_head;
+	policy_simulation_remove_entry(ps, victim);
+}
+
 void policy_simulation_evict(struct policy_simulation *ps, unsigned long num_to_evict) {
 	int size = policy_simulation_size(ps);
 	if (num_to_evict >= size) return;
 
 	while(num_to_evict--) {
-		struct list_entry *del_entry = ps->list_head;
-		DL_DELETE(ps->list_head, del_entry);
-		if (del_entry && del_entry->payload) {
-			// WARNING: If payload points to a struct with other pointers in it that need to be freed, this will cause a memory leak
-            // Future work: have user provide a cleanup function for the payload, call it on payload and set payload to NULL
-			free(del_entry->payload);
-		}
-		free(del_entry);
+		policy_simulation_evict_one(ps);
 	}
 }
 
@@ -71,13 +207,20 @@ float policy_simulation_total_hit_percent(struct policy_simulation *ps) {
 	}
 }
 
-float policy_simulation_task_hit_percent(struct policy_simulation *ps, const struct task_key *key) {
-	struct task_stats_entry *tse = NULL;
+// Counts for a task this simulation may never have seen are all 0
+struct task_stats policy_simulation_task_stats(struct policy_simulation *ps, unsigned int task_id) {
+	struct task_stats ts = { 0, 0 };
+	if (task_id < ps->num_task_stats) {
+		ts = ps->task_stats[task_id];
+	}
+	return ts;
+}
+
+float policy_simulation_task_hit_percent(struct policy_simulation *ps, unsigned int task_id) {
     assert(ps);
-    assert(key);
-	HASH_FIND(hh, ps->task_stats, key, sizeof(struct task_key), tse);
-	if (tse) {
-		return 100.0 * ((float)tse->hits / (float)(tse->hits + tse->misses));
+	struct task_stats ts = policy_simulation_task_stats(ps, task_id);
+	if (ts.hits + ts.misses > 0) {
+		return 100.0 * ((float)ts.hits / (float)(ts.hits + ts.misses));
 	} else {
 		return -1;
 	}
@@ -85,99 +228,996 @@ float policy_simulation_task_hit_percent(struct policy_simulation *ps, const str
 
 int policy_simulation_size(struct policy_simulation *ps) {
     assert(ps);
-	struct list_entry *entry;
-	int size;
-	DL_COUNT(ps->list_head, entry, size);
-	return size;
+	return ps->entries.size;
 }
 
 void policy_simulation_print(struct policy_simulation *ps) {
     assert(ps);
-	struct list_entry *entry = NULL;
 	int position = 0;
-	DL_FOREACH(ps->list_head, entry) {
-        if(entry) printf("Position: %d, Folio: %lu\n", position++, entry->folio);
-		//printf("Position: %d, Folio: %lu, Payload: %lu\n", position++, entry->folio, *(unsigned long *)entry->payload);
+	for (uint32_t slot = ps->list_head; slot != SLOT_NONE; slot = ps->entries.next[slot]) {
+		printf("Position: %d, Folio: %lu\n", position++, ps->entries.folios[slot]);
 	}
 
 	printf("Size: %d, Hits: %lu, Misses: %lu\n", policy_simulation_size(ps), ps->hits, ps->misses);
 }
 
-void fifo_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry) {
+// Saves everything the simulation has replayed so far. Fails the checkpoint
+// if the policy keeps state it can't save, like OPT's view of the future.
+void policy_simulation_save(struct policy_simulation *ps, struct checkpoint *c) {
+	uint32_t has_data = ps->policy_data != NULL;
+	if (has_data && !ps->policy->save) {
+		c->failed = 1;
+		return;
+	}
+	checkpoint_write_array(c, ps->policy->name, 1, strlen(ps->policy->name));
+	checkpoint_write(c, &ps->capacity, sizeof(ps->capacity));
+	checkpoint_write(c, &ps->hits, sizeof(ps->hits));
+	checkpoint_write(c, &ps->misses, sizeof(ps->misses));
+	checkpoint_write_array(c, ps->task_stats, sizeof(struct task_stats), ps->num_task_stats);
+	folio_table_save(&ps->entries, c);
+	checkpoint_write(c, &ps->list_head, sizeof(ps->list_head));
+	checkpoint_write(c, &has_data, sizeof(has_data));
+	if (has_data) {
+		(*ps->policy->save)(ps, c);
+	}
+}
+
+// Restores a saved simulation into ps, a new simulation of the same policy
+void policy_simulation_load(struct policy_simulation *ps, struct checkpoint *c) {
+	uint64_t len;
+	char *name = (char *)checkpoint_read_array(c, 1, &len);
+	if (len != strlen(ps->policy->name) || memcmp(name, ps->policy->name, len)) {
+		c->failed = 1;
+	}
+	free(name);
+	checkpoint_read(c, &ps->capacity, sizeof(ps->capacity));
+	checkpoint_read(c, &ps->hits, sizeof(ps->hits));
+	checkpoint_read(c, &ps->misses, sizeof(ps->misses));
+	uint64_t num_task_stats;
+	free(ps->task_stats);
+	ps->task_stats = (struct task_stats *)checkpoint_read_array(c, sizeof(struct task_stats), &num_task_stats);
+	ps->num_task_stats = num_task_stats;
+	folio_table_load(&ps->entries, c);
+	checkpoint_read(c, &ps->list_head, sizeof(ps->list_head));
+	uint32_t has_data;
+	checkpoint_read(c, &has_data, sizeof(has_data));
+	if (has_data && !ps->policy->load) {
+		c->failed = 1;
+	}
+	if (has_data && !c->failed) {
+		(*ps->policy->load)(ps, c);
+	}
+}
+
+void fifo_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
 	// Do nothing on hit
 	return;
 }
 
 void fifo_miss_update(struct policy_simulation *ps, unsigned long folio) {
-	struct list_entry *entry = (struct list_entry *)malloc(sizeof(struct list_entry));
-	entry->folio = folio;
-	entry->payload = NULL;
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
 
-	// Make entry the new tail of the list
-	DL_APPEND(ps->list_head, entry);
+	// Make slot the new tail of the list
+	list_append(ps, slot);
 }
 
-int lfu_payload_cmp(struct list_entry *left, struct list_entry *right) {
-	unsigned long l = *(unsigned long *)left->payload;
-	unsigned long r = *(unsigned long *)right->payload;
+// LFU keeps list_head sorted by access count. Slots with the same count form
+// a contiguous run, and each run is tracked by a bucket (entries.values) that
+// points at the run's first slot. The buckets are kept in ascending count
+// order, so moving a slot to the next count and evicting from the head are
+// both O(1). Within a run the most recent arrival comes first, which is the
+// order the original sorted insert produced.
 
-	if (l < r) {
-		return -1;
-	} else if(l == r) {
-		return 0;
+struct lfu_data *lfu_data(struct policy_simulation *ps) {
+	if (!ps->policy_data) {
+		struct lfu_data *ld = (struct lfu_data *)calloc(1, sizeof(struct lfu_data));
+		ld->head = SLOT_NONE;
+		ld->free_buckets = SLOT_NONE;
+		ps->policy_data = ld;
+	}
+	return ps->policy_data;
+}
+
+uint32_t lfu_bucket_new(struct lfu_data *ld) {
+	if (ld->free_buckets == SLOT_NONE) {
+		uint32_t num_buckets = ld->num_buckets ? 2 * ld->num_buckets : 64;
+		ld->prev = (uint32_t *)realloc(ld->prev, num_buckets * sizeof(uint32_t));
+		ld->next = (uint32_t *)realloc(ld->next, num_buckets * sizeof(uint32_t));
+		ld->counts = (unsigned long *)realloc(ld->counts, num_buckets * sizeof(unsigned long));
+		ld->first = (uint32_t *)realloc(ld->first, num_buckets * sizeof(uint32_t));
+		for (uint32_t bucket = num_buckets; bucket-- > ld->num_buckets;) {
+			ld->next[bucket] = ld->free_buckets;
+			ld->free_buckets = bucket;
+		}
+		ld->num_buckets = num_buckets;
+	}
+
+	uint32_t bucket = ld->free_buckets;
+	ld->free_buckets = ld->next[bucket];
+	return bucket;
+}
+
+// Detaches slot from its bucket, freeing the bucket once its run is empty.
+// The slot itself stays in list_head.
+void lfu_bucket_remove(struct policy_simulation *ps, uint32_t slot) {
+	struct lfu_data *ld = lfu_data(ps);
+	uint32_t bucket = ps->entries.values[slot];
+
+	if (ld->first[bucket] == slot) {
+		uint32_t next = ps->entries.next[slot];
+		if (next != SLOT_NONE && ps->entries.values[next] == bucket) {
+			ld->first[bucket] = next;
+		} else {
+			slot_list_delete(ld->prev, ld->next, &ld->head, bucket);
+			ld->next[bucket] = ld->free_buckets;
+			ld->free_buckets = bucket;
+		}
+	}
+}
+
+// Makes slot the first member of a bucket with the given count that sits
+// right before next_bucket (or at the tail of the buckets if SLOT_NONE). The
+// slot must not be in list_head.
+void lfu_bucket_insert(struct policy_simulation *ps, uint32_t slot, unsigned long count, uint32_t next_bucket) {
+	struct lfu_data *ld = lfu_data(ps);
+	uint32_t bucket;
+	uint32_t run_start;
+
+	if (next_bucket != SLOT_NONE && ld->counts[next_bucket] == count) {
+		bucket = next_bucket;
+		run_start = ld->first[bucket];
 	} else {
-		return 1;
+		bucket = lfu_bucket_new(ld);
+		ld->counts[bucket] = count;
+		slot_list_insert_before(ld->prev, ld->next, &ld->head, next_bucket, bucket);
+		// A new run starts right before the run of the next larger count
+		run_start = next_bucket != SLOT_NONE ? ld->first[next_bucket] : SLOT_NONE;
 	}
+
+	list_insert_before(ps, run_start, slot);
+	ld->first[bucket] = slot;
+	ps->entries.values[slot] = bucket;
 }
 
-void lfu_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry) {
-	*(unsigned long *)hit_entry->payload += 1;
+void lfu_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	lfu_repeat_update(ps, hit_slot, 1);
+}
 
-	// Remove hit_entry from the list
-	DL_DELETE(ps->list_head, hit_entry);
+// Every repeat counts, so a weighted access can skip past several buckets
+void lfu_repeat_update(struct policy_simulation *ps, uint32_t slot, unsigned long repeats) {
+	struct lfu_data *ld = lfu_data(ps);
+	uint32_t bucket = ps->entries.values[slot];
+	unsigned long count = ld->counts[bucket] + repeats;
+	uint32_t next_bucket = ld->next[bucket];
+	while (next_bucket != SLOT_NONE && ld->counts[next_bucket] < count) {
+		next_bucket = ld->next[next_bucket];
+	}
 
-	// Insert hit_entry in sorted order
-	DL_INSERT_INORDER(ps->list_head, hit_entry, lfu_payload_cmp);
+	lfu_bucket_remove(ps, slot);
+	list_delete(ps, slot);
+	lfu_bucket_insert(ps, slot, count, next_bucket);
 }
 
 void lfu_miss_update(struct policy_simulation *ps, unsigned long folio) {
-	struct list_entry *entry = (struct list_entry *)malloc(sizeof(struct list_entry));
-	entry->folio = folio;
-	entry->payload = malloc(sizeof(unsigned long));
-	*(unsigned long *)entry->payload = 0;
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
+
+	// Make slot the first member of the lowest count, i.e. the new head of the list
+	lfu_bucket_insert(ps, slot, 0, lfu_data(ps)->head);
+}
 
-	// Make entry the new head of the list
-	DL_PREPEND(ps->list_head, entry);
+void lfu_evict_update(struct policy_simulation *ps, uint32_t evict_slot) {
+	lfu_bucket_remove(ps, evict_slot);
 }
 
-void lru_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry) {
-	// Remove hit_entry from the list
-	DL_DELETE(ps->list_head, hit_entry);
-	// Make hit_entry the new tail of the list
-	DL_APPEND(ps->list_head, hit_entry);
+void lfu_save(struct policy_simulation *ps, struct checkpoint *c) {
+	struct lfu_data *ld = lfu_data(ps);
+	checkpoint_write(c, &ld->head, sizeof(ld->head));
+	checkpoint_write(c, &ld->free_buckets, sizeof(ld->free_buckets));
+	checkpoint_write_array(c, ld->prev, sizeof(uint32_t), ld->num_buckets);
+	checkpoint_write_array(c, ld->next, sizeof(uint32_t), ld->num_buckets);
+	checkpoint_write_array(c, ld->counts, sizeof(unsigned long), ld->num_buckets);
+	checkpoint_write_array(c, ld->first, sizeof(uint32_t), ld->num_buckets);
+}
+
+void lfu_load(struct policy_simulation *ps, struct checkpoint *c) {
+	struct lfu_data *ld = lfu_data(ps);
+	uint64_t counts[4];
+	checkpoint_read(c, &ld->head, sizeof(ld->head));
+	checkpoint_read(c, &ld->free_buckets, sizeof(ld->free_buckets));
+	free(ld->prev);
+	free(ld->next);
+	free(ld->counts);
+	free(ld->first);
+	ld->prev = (uint32_t *)checkpoint_read_array(c, sizeof(uint32_t), &counts[0]);
+	ld->next = (uint32_t *)checkpoint_read_array(c, sizeof(uint32_t), &counts[1]);
+	ld->counts = (unsigned long *)checkpoint_read_array(c, sizeof(unsigned long), &counts[2]);
+	ld->first = (uint32_t *)checkpoint_read_array(c, sizeof(uint32_t), &counts[3]);
+	ld->num_buckets = counts[0];
+	if (counts[1] != counts[0] || counts[2] != counts[0] || counts[3] != counts[0]) {
+		c->failed = 1;
+	}
+}
+
+void lru_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	// Remove hit_slot from the list
+	list_delete(ps, hit_slot);
+	// Make hit_slot the new tail of the list
+	list_append(ps, hit_slot);
 }
 
 void lru_miss_update(struct policy_simulation *ps, unsigned long folio) {
-	struct list_entry *entry = (struct list_entry *)malloc(sizeof(struct list_entry));
-	entry->folio = folio;
-	entry->payload = NULL;
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
 
-	// Make entry the new tail of the list
-	DL_APPEND(ps->list_head, entry);
+	// Make slot the new tail of the list
+	list_append(ps, slot);
 }
 
-void mru_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry) {
-	// Remove hit_entry from the list
-	DL_DELETE(ps->list_head, hit_entry);
-	// Make hit_entry the new head of the list
-	DL_PREPEND(ps->list_head, hit_entry);
+void mru_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	// Remove hit_slot from the list
+	list_delete(ps, hit_slot);
+	// Make hit_slot the new head of the list
+	list_prepend(ps, hit_slot);
 }
 
 void mru_miss_update(struct policy_simulation *ps, unsigned long folio) {
-	struct list_entry *entry = (struct list_entry *)malloc(sizeof(struct list_entry));
-	entry->folio = folio;
-	entry->payload = NULL;
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
+
+	// Make slot the new head of the list
+	list_prepend(ps, slot);
+}
+
+/*
+ * Linux emulates the kernel's inactive and active file lists. Folios enter
+ * the inactive list. folio_mark_accessed sets the referenced flag on the
+ * first access and moves a referenced inactive folio to the active list on
+ * the next. Reclaim takes the oldest inactive folio, first moving the oldest
+ * active folios to the inactive list while the inactive list is low, as
+ * inactive_is_low does. Reclaim only sees unmapped page cache here, so the
+ * referenced flag doesn't save a folio from it.
+ */
+
+struct linux_lru_data *linux_lru_data(struct policy_simulation *ps) {
+	if (!ps->policy_data) {
+		struct linux_lru_data *ld = (struct linux_lru_data *)calloc(1, sizeof(struct linux_lru_data));
+		ld->first_active = SLOT_NONE;
+		ld->inactive_ratio = 1;
+		ps->policy_data = ld;
+	}
+	return ps->policy_data;
+}
+
+// The oldest active folio becomes the newest inactive one, which in
+// list_head only moves the boundary between the lists
+void linux_deactivate_oldest(struct policy_simulation *ps, struct linux_lru_data *ld) {
+	ps->entries.values[ld->first_active] &= ~LINUX_ACTIVE;
+	ld->first_active = ps->entries.next[ld->first_active];
+	ld->num_active--;
+	ld->num_inactive++;
+}
+
+// The inactive list is low when it is smaller than the active list divided by
+// sqrt(10 * the size of both in GB), or just the active list below 1 GB
+int linux_inactive_is_low(struct linux_lru_data *ld) {
+	unsigned long gb = (ld->num_active + ld->num_inactive) >> (30 - 12);
+	if (gb != ld->gb) {
+		ld->gb = gb;
+		ld->inactive_ratio = 1;
+		while ((ld->inactive_ratio + 1) * (ld->inactive_ratio + 1) <= 10 * gb) {
+			ld->inactive_ratio++;
+		}
+	}
+	return ld->num_inactive * ld->inactive_ratio < ld->num_active;
+}
 
-	// Make entry the new head of the list
-	DL_PREPEND(ps->list_head, entry);
+void linux_activate(struct policy_simulation *ps, uint32_t slot) {
+	struct linux_lru_data *ld = linux_lru_data(ps);
+	list_delete(ps, slot);
+	list_append(ps, slot);
+	if (ld->first_active == SLOT_NONE) {
+		ld->first_active = slot;
+	}
+	ps->entries.values[slot] = LINUX_ACTIVE;
+	ld->num_inactive--;
+	ld->num_active++;
+}
+
+void linux_mark_accessed(struct policy_simulation *ps, uint32_t slot) {
+	uint32_t value = ps->entries.values[slot];
+	if (!(value & LINUX_REFERENCED)) {
+		ps->entries.values[slot] = value | LINUX_REFERENCED;
+	} else if (!(value & LINUX_ACTIVE)) {
+		linux_activate(ps, slot);
+	}
+}
+
+// Only folio_mark_accessed moves a folio, dirtying it doesn't
+void linux_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	if (ps->event->type == FMA) {
+		linux_mark_accessed(ps, hit_slot);
+	}
+}
+
+void linux_miss_update(struct policy_simulation *ps, unsigned long folio) {
+	struct linux_lru_data *ld = linux_lru_data(ps);
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
+
+	// Make slot the newest inactive folio, right before the active list
+	list_insert_before(ps, ld->first_active, slot);
+	ld->num_inactive++;
+	if (ps->event->type == FMA) {
+		linux_mark_accessed(ps, slot);
+	}
 }
+
+// Past the second access, more repeats don't change anything
+void linux_repeat_update(struct policy_simulation *ps, uint32_t slot, unsigned long repeats) {
+	for (unsigned long i = 0; i < repeats && i < 2; i++) {
+		linux_mark_accessed(ps, slot);
+	}
+}
+
+void linux_evict_update(struct policy_simulation *ps, uint32_t evict_slot) {
+	struct linux_lru_data *ld = linux_lru_data(ps);
+	if (ld->first_active == evict_slot) {
+		ld->first_active = ps->entries.next[evict_slot];
+	}
+	if (ps->entries.values[evict_slot] & LINUX_ACTIVE) {
+		ld->num_active--;
+	} else {
+		ld->num_inactive--;
+	}
+}
+
+uint32_t linux_victim(struct policy_simulation *ps) {
+	struct linux_lru_data *ld = linux_lru_data(ps);
+	while (ld->first_active != SLOT_NONE && (!ld->num_inactive || linux_inactive_is_low(ld))) {
+		linux_deactivate_oldest(ps, ld);
+	}
+	return ps->list_head;
+}
+
+void linux_save(struct policy_simulation *ps, struct checkpoint *c) {
+	struct linux_lru_data *ld = linux_lru_data(ps);
+	checkpoint_write(c, &ld->first_active, sizeof(ld->first_active));
+	checkpoint_write(c, &ld->num_active, sizeof(ld->num_active));
+	checkpoint_write(c, &ld->num_inactive, sizeof(ld->num_inactive));
+	checkpoint_write(c, &ld->gb, sizeof(ld->gb));
+	checkpoint_write(c, &ld->inactive_ratio, sizeof(ld->inactive_ratio));
+}
+
+void linux_load(struct policy_simulation *ps, struct checkpoint *c) {
+	struct linux_lru_data *ld = linux_lru_data(ps);
+	checkpoint_read(c, &ld->first_active, sizeof(ld->first_active));
+	checkpoint_read(c, &ld->num_active, sizeof(ld->num_active));
+	checkpoint_read(c, &ld->num_inactive, sizeof(ld->num_inactive));
+	checkpoint_read(c, &ld->gb, sizeof(ld->gb));
+	checkpoint_read(c, &ld->inactive_ratio, sizeof(ld->inactive_ratio));
+}
+
+void ghost_lists_init(struct ghost_lists *gl) {
+	folio_table_init(&gl->table);
+	gl->lists[0] = SLOT_NONE;
+	gl->lists[1] = SLOT_NONE;
+	gl->sizes[0] = 0;
+	gl->sizes[1] = 0;
+}
+
+// Returns the slot of folio's ghost, SLOT_NONE if it has none
+uint32_t ghost_find(struct ghost_lists *gl, unsigned long folio) {
+	return folio_table_find(&gl->table, folio);
+}
+
+// Makes folio the newest ghost of list
+void ghost_add(struct ghost_lists *gl, int list, unsigned long folio) {
+	uint32_t slot = folio_table_add(&gl->table, folio);
+	gl->table.values[slot] = list;
+	slot_list_append(gl->table.prev, gl->table.next, &gl->lists[list], slot);
+	gl->sizes[list]++;
+}
+
+void ghost_remove(struct ghost_lists *gl, uint32_t slot) {
+	int list = gl->table.values[slot];
+	slot_list_delete(gl->table.prev, gl->table.next, &gl->lists[list], slot);
+	gl->sizes[list]--;
+	folio_table_remove(&gl->table, slot);
+}
+
+// Forgets the oldest ghost of list
+void ghost_pop(struct ghost_lists *gl, int list) {
+	ghost_remove(gl, gl->lists[list]);
+}
+
+void ghost_lists_save(struct ghost_lists *gl, struct checkpoint *c) {
+	folio_table_save(&gl->table, c);
+	checkpoint_write(c, gl->lists, sizeof(gl->lists));
+	checkpoint_write(c, gl->sizes, sizeof(gl->sizes));
+}
+
+void ghost_lists_load(struct ghost_lists *gl, struct checkpoint *c) {
+	folio_table_load(&gl->table, c);
+	checkpoint_read(c, gl->lists, sizeof(gl->lists));
+	checkpoint_read(c, gl->sizes, sizeof(gl->sizes));
+}
+
+// The capacity ARC, 2Q and CLOCK-Pro size their lists by. Without a fixed
+// capacity the recorded evictions decide, and the lists follow the resident size.
+unsigned long policy_simulation_target_size(struct policy_simulation *ps) {
+	unsigned long size = policy_simulation_size(ps);
+	if (ps->capacity) {
+		return ps->capacity;
+	}
+	return size ? size : 1;
+}
+
+// The folio about to be added after this eviction, 0 if the eviction isn't for a miss
+unsigned long policy_simulation_incoming(struct policy_simulation *ps) {
+	return ps->event && ps->event->type != SFL ? ps->event->folio : 0;
+}
+
+/*
+ * ARC (Megiddo and Modha) splits the cache between T1, folios seen once
+ * recently, and T2, folios seen at least twice. B1 and B2 remember what was
+ * evicted from each. A miss that finds its folio in B1 grows T1's target p,
+ * one in B2 shrinks it, and evictions take the LRU of T1 while T1 is over p.
+ * The lists are bounded so that T1 + B1 and B2 each stay within the capacity.
+ */
+
+struct arc_data *arc_data(struct policy_simulation *ps) {
+	if (!ps->policy_data) {
+		struct arc_data *ad = (struct arc_data *)calloc(1, sizeof(struct arc_data));
+		ghost_lists_init(&ad->ghosts);
+		ad->first_t2 = SLOT_NONE;
+		ps->policy_data = ad;
+	}
+	return ps->policy_data;
+}
+
+void arc_adapt(struct policy_simulation *ps, unsigned long folio) {
+	struct arc_data *ad = arc_data(ps);
+	uint32_t ghost = ghost_find(&ad->ghosts, folio);
+	unsigned long c = policy_simulation_target_size(ps);
+	unsigned long b1 = ad->ghosts.sizes[0];
+	unsigned long b2 = ad->ghosts.sizes[1];
+
+	if (ghost == SLOT_NONE) {
+		return;
+	}
+	if (ad->ghosts.table.values[ghost] == 0) {
+		unsigned long delta = b2 > b1 ? b2 / b1 : 1;
+		ad->p = ad->p + delta < c ? ad->p + delta : c;
+	} else {
+		unsigned long delta = b1 > b2 ? b1 / b2 : 1;
+		ad->p = ad->p > delta ? ad->p - delta : 0;
+	}
+}
+
+// Drops ghosts until T1 + B1 fits in the capacity and all four lists in twice that
+void arc_trim_ghosts(struct policy_simulation *ps) {
+	struct arc_data *ad = arc_data(ps);
+	unsigned long c = policy_simulation_target_size(ps);
+	while (ad->ghosts.sizes[0] && ad->num_t1 + ad->ghosts.sizes[0] > c) {
+		ghost_pop(&ad->ghosts, 0);
+	}
+	while (ad->ghosts.sizes[0] + ad->ghosts.sizes[1] && ad->num_t1 + ad->num_t2 + ad->ghosts.sizes[0] + ad->ghosts.sizes[1] > 2 * c) {
+		ghost_pop(&ad->ghosts, ad->ghosts.sizes[1] ? 1 : 0);
+	}
+}
+
+void arc_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	struct arc_data *ad = arc_data(ps);
+	if (ad->first_t2 == hit_slot) {
+		ad->first_t2 = ps->entries.next[hit_slot];
+	}
+	list_delete(ps, hit_slot);
+	list_append(ps, hit_slot);
+	if (ad->first_t2 == SLOT_NONE) {
+		ad->first_t2 = hit_slot;
+	}
+	if (!(ps->entries.values[hit_slot] & ARC_T2)) {
+		ps->entries.values[hit_slot] = ARC_T2;
+		ad->num_t1--;
+		ad->num_t2++;
+	}
+}
+
+void arc_miss_update(struct policy_simulation *ps, unsigned long folio) {
+	struct arc_data *ad = arc_data(ps);
+	if (!ad->adapted) {
+		arc_adapt(ps, folio);
+	}
+	ad->adapted = 0;
+
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
+	uint32_t ghost = ghost_find(&ad->ghosts, folio);
+	if (ghost != SLOT_NONE) {
+		// Seen before, straight to the MRU end of T2
+		ghost_remove(&ad->ghosts, ghost);
+		list_append(ps, slot);
+		if (ad->first_t2 == SLOT_NONE) {
+			ad->first_t2 = slot;
+		}
+		ps->entries.values[slot] = ARC_T2;
+		ad->num_t2++;
+	} else {
+		// The MRU end of T1 is right before T2
+		list_insert_before(ps, ad->first_t2, slot);
+		ad->num_t1++;
+	}
+	arc_trim_ghosts(ps);
+}
+
+// Any number of repeats is a second access
+void arc_repeat_update(struct policy_simulation *ps, uint32_t slot, unsigned long repeats) {
+	arc_hit_update(ps, slot);
+}
+
+void arc_evict_update(struct policy_simulation *ps, uint32_t evict_slot) {
+	struct arc_data *ad = arc_data(ps);
+	if (ad->first_t2 == evict_slot) {
+		ad->first_t2 = ps->entries.next[evict_slot];
+	}
+	int list = ps->entries.values[evict_slot] & ARC_T2 ? 1 : 0;
+	if (list) {
+		ad->num_t2--;
+	} else {
+		ad->num_t1--;
+	}
+	if (!ad->no_ghost) {
+		ghost_add(&ad->ghosts, list, ps->entries.folios[evict_slot]);
+	}
+	ad->no_ghost = 0;
+	arc_trim_ghosts(ps);
+}
+
+// ARC's REPLACE, plus the case where L1 is full of resident folios and the
+// LRU of T1 is evicted without a ghost
+uint32_t arc_victim(struct policy_simulation *ps) {
+	struct arc_data *ad = arc_data(ps);
+	unsigned long folio = policy_simulation_incoming(ps);
+	uint32_t ghost = SLOT_NONE;
+	if (folio) {
+		arc_adapt(ps, folio);
+		ad->adapted = 1;
+		ghost = ghost_find(&ad->ghosts, folio);
+		if (ghost == SLOT_NONE && ad->num_t1 >= policy_simulation_target_size(ps)) {
+			ad->no_ghost = 1;
+			return ps->list_head;
+		}
+	}
+
+	int in_b2 = ghost != SLOT_NONE && ad->ghosts.table.values[ghost] == 1;
+	if (ad->num_t1 && ((in_b2 && ad->num_t1 == ad->p) || ad->num_t1 > ad->p || ad->first_t2 == SLOT_NONE)) {
+		return ps->list_head;
+	}
+	return ad->first_t2;
+}
+
+void arc_save(struct policy_simulation *ps, struct checkpoint *c) {
+	struct arc_data *ad = arc_data(ps);
+	ghost_lists_save(&ad->ghosts, c);
+	checkpoint_write(c, &ad->first_t2, sizeof(ad->first_t2));
+	checkpoint_write(c, &ad->num_t1, sizeof(ad->num_t1));
+	checkpoint_write(c, &ad->num_t2, sizeof(ad->num_t2));
+	checkpoint_write(c, &ad->p, sizeof(ad->p));
+}
+
+// adapted and no_ghost only last for the access being replayed, so they are 0 here
+void arc_load(struct policy_simulation *ps, struct checkpoint *c) {
+	struct arc_data *ad = arc_data(ps);
+	ghost_lists_load(&ad->ghosts, c);
+	checkpoint_read(c, &ad->first_t2, sizeof(ad->first_t2));
+	checkpoint_read(c, &ad->num_t1, sizeof(ad->num_t1));
+	checkpoint_read(c, &ad->num_t2, sizeof(ad->num_t2));
+	checkpoint_read(c, &ad->p, sizeof(ad->p));
+}
+
+/*
+ * 2Q (Johnson and Shasha). New folios enter A1in, a FIFO of a quarter of the
+ * capacity, and hits there don't count as reuse. Folios evicted from A1in are
+ * remembered in A1out, up to half the capacity, and a miss that finds its
+ * folio there goes to Am, an LRU holding the rest. Evictions take A1in while
+ * it is over its share, and the LRU of Am otherwise.
+ */
+
+struct twoq_data *twoq_data(struct policy_simulation *ps) {
+	if (!ps->policy_data) {
+		struct twoq_data *td = (struct twoq_data *)calloc(1, sizeof(struct twoq_data));
+		ghost_lists_init(&td->ghosts);
+		td->first_am = SLOT_NONE;
+		ps->policy_data = td;
+	}
+	return ps->policy_data;
+}
+
+void twoq_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	struct twoq_data *td = twoq_data(ps);
+	if (!(ps->entries.values[hit_slot] & TWOQ_AM)) {
+		return;
+	}
+	if (td->first_am == hit_slot) {
+		td->first_am = ps->entries.next[hit_slot];
+	}
+	list_delete(ps, hit_slot);
+	list_append(ps, hit_slot);
+	if (td->first_am == SLOT_NONE) {
+		td->first_am = hit_slot;
+	}
+}
+
+void twoq_miss_update(struct policy_simulation *ps, unsigned long folio) {
+	struct twoq_data *td = twoq_data(ps);
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
+	uint32_t ghost = ghost_find(&td->ghosts, folio);
+	if (ghost != SLOT_NONE) {
+		ghost_remove(&td->ghosts, ghost);
+		list_append(ps, slot);
+		if (td->first_am == SLOT_NONE) {
+			td->first_am = slot;
+		}
+		ps->entries.values[slot] = TWOQ_AM;
+		td->num_am++;
+	} else {
+		// The newest end of A1in is right before Am
+		list_insert_before(ps, td->first_am, slot);
+		td->num_a1in++;
+	}
+}
+
+void twoq_evict_update(struct policy_simulation *ps, uint32_t evict_slot) {
+	struct twoq_data *td = twoq_data(ps);
+	if (td->first_am == evict_slot) {
+		td->first_am = ps->entries.next[evict_slot];
+	}
+	if (ps->entries.values[evict_slot] & TWOQ_AM) {
+		td->num_am--;
+		return;
+	}
+
+	td->num_a1in--;
+	ghost_add(&td->ghosts, 0, ps->entries.folios[evict_slot]);
+	unsigned long kout = policy_simulation_target_size(ps) / 2;
+	while (td->ghosts.sizes[0] > (kout ? kout : 1)) {
+		ghost_pop(&td->ghosts, 0);
+	}
+}
+
+uint32_t twoq_victim(struct policy_simulation *ps) {
+	struct twoq_data *td = twoq_data(ps);
+	unsigned long kin = policy_simulation_target_size(ps) / 4;
+	if (td->num_a1in && (td->num_a1in > (kin ? kin : 1) || td->first_am == SLOT_NONE)) {
+		return ps->list_head;
+	}
+	return td->first_am;
+}
+
+void twoq_save(struct policy_simulation *ps, struct checkpoint *c) {
+	struct twoq_data *td = twoq_data(ps);
+	ghost_lists_save(&td->ghosts, c);
+	checkpoint_write(c, &td->first_am, sizeof(td->first_am));
+	checkpoint_write(c, &td->num_a1in, sizeof(td->num_a1in));
+	checkpoint_write(c, &td->num_am, sizeof(td->num_am));
+}
+
+void twoq_load(struct policy_simulation *ps, struct checkpoint *c) {
+	struct twoq_data *td = twoq_data(ps);
+	ghost_lists_load(&td->ghosts, c);
+	checkpoint_read(c, &td->first_am, sizeof(td->first_am));
+	checkpoint_read(c, &td->num_a1in, sizeof(td->num_a1in));
+	checkpoint_read(c, &td->num_am, sizeof(td->num_am));
+}
+
+/*
+ * CLOCK-Pro (Jiang, Chen and Zhang). Resident folios are hot or cold, and
+ * a cold folio starts a test period when it is brought in. Hits only set the
+ * referenced flag. Evictions run hand_cold over the clock: a referenced cold
+ * folio in its test period turns hot, a referenced one outside it starts a
+ * new test period, and the first unreferenced cold folio is evicted, leaving
+ * a ghost if it was still in its test period. A miss on a ghost turns the
+ * folio hot and grows the cold target, and a test period that ends without a
+ * reuse shrinks it. Whenever there are more hot folios than the capacity
+ * minus the cold target, hand_hot turns the first unreferenced hot folio
+ * cold, ending the test periods it passes. Ghosts are bounded to the
+ * capacity, oldest first.
+ */
+
+struct clockpro_data *clockpro_data(struct policy_simulation *ps) {
+	if (!ps->policy_data) {
+		struct clockpro_data *cd = (struct clockpro_data *)calloc(1, sizeof(struct clockpro_data));
+		ghost_lists_init(&cd->ghosts);
+		cd->hand_hot = SLOT_NONE;
+		cd->hand_cold = SLOT_NONE;
+		cd->cold_target = 1;
+		ps->policy_data = cd;
+	}
+	return ps->policy_data;
+}
+
+uint32_t clockpro_next(struct policy_simulation *ps, uint32_t slot) {
+	uint32_t next = ps->entries.next[slot];
+	return next != SLOT_NONE ? next : ps->list_head;
+}
+
+// Moves any hand pointing at slot off it, before slot leaves list_head
+void clockpro_release_hands(struct policy_simulation *ps, uint32_t slot) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	uint32_t next = clockpro_next(ps, slot);
+	if (next == slot) {
+		next = SLOT_NONE;
+	}
+	if (cd->hand_hot == slot) {
+		cd->hand_hot = next;
+	}
+	if (cd->hand_cold == slot) {
+		cd->hand_cold = next;
+	}
+}
+
+// The head of the clock is right behind hand_hot, the last place either hand reaches
+void clockpro_insert_head(struct policy_simulation *ps, uint32_t slot) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	if (cd->hand_hot == SLOT_NONE) {
+		list_append(ps, slot);
+		cd->hand_hot = slot;
+		cd->hand_cold = slot;
+	} else {
+		list_insert_before(ps, cd->hand_hot, slot);
+	}
+}
+
+void clockpro_move_to_head(struct policy_simulation *ps, uint32_t slot) {
+	clockpro_release_hands(ps, slot);
+	list_delete(ps, slot);
+	clockpro_insert_head(ps, slot);
+}
+
+void clockpro_end_test(struct clockpro_data *cd) {
+	if (cd->cold_target > 1) {
+		cd->cold_target--;
+	}
+}
+
+// Turns one hot folio cold
+void clockpro_run_hand_hot(struct policy_simulation *ps) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	uint32_t *values = ps->entries.values;
+	while (cd->num_hot) {
+		uint32_t slot = cd->hand_hot;
+		cd->hand_hot = clockpro_next(ps, slot);
+		if (values[slot] & CLOCKPRO_HOT) {
+			if (values[slot] & CLOCKPRO_REFERENCED) {
+				values[slot] &= ~CLOCKPRO_REFERENCED;
+				continue;
+			}
+			values[slot] = 0;
+			cd->num_hot--;
+			cd->num_cold++;
+			return;
+		}
+		if (values[slot] & CLOCKPRO_TEST) {
+			values[slot] &= ~CLOCKPRO_TEST;
+			clockpro_end_test(cd);
+		}
+	}
+}
+
+void clockpro_balance(struct policy_simulation *ps) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	unsigned long c = policy_simulation_target_size(ps);
+	unsigned long max_hot = c > cd->cold_target ? c - cd->cold_target : 0;
+	while (cd->num_hot > max_hot || (cd->num_hot && !cd->num_cold)) {
+		clockpro_run_hand_hot(ps);
+	}
+}
+
+void clockpro_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	ps->entries.values[hit_slot] |= CLOCKPRO_REFERENCED;
+}
+
+void clockpro_miss_update(struct policy_simulation *ps, unsigned long folio) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
+	uint32_t ghost = ghost_find(&cd->ghosts, folio);
+	if (ghost != SLOT_NONE) {
+		ghost_remove(&cd->ghosts, ghost);
+		unsigned long c = policy_simulation_target_size(ps);
+		cd->cold_target = cd->cold_target < c ? cd->cold_target + 1 : c;
+		ps->entries.values[slot] = CLOCKPRO_HOT;
+		cd->num_hot++;
+	} else {
+		ps->entries.values[slot] = CLOCKPRO_TEST;
+		cd->num_cold++;
+	}
+	clockpro_insert_head(ps, slot);
+	clockpro_balance(ps);
+}
+
+void clockpro_evict_update(struct policy_simulation *ps, uint32_t evict_slot) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	clockpro_release_hands(ps, evict_slot);
+	if (ps->entries.values[evict_slot] & CLOCKPRO_HOT) {
+		cd->num_hot--;
+		return;
+	}
+
+	cd->num_cold--;
+	if (ps->entries.values[evict_slot] & CLOCKPRO_TEST) {
+		ghost_add(&cd->ghosts, 0, ps->entries.folios[evict_slot]);
+		while (cd->ghosts.sizes[0] > policy_simulation_target_size(ps)) {
+			ghost_pop(&cd->ghosts, 0);
+			clockpro_end_test(cd);
+		}
+	}
+}
+
+uint32_t clockpro_victim(struct policy_simulation *ps) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	uint32_t *values = ps->entries.values;
+	for (;;) {
+		if (!cd->num_cold) {
+			clockpro_run_hand_hot(ps);
+		}
+		uint32_t slot = cd->hand_cold;
+		if (values[slot] & CLOCKPRO_HOT) {
+			cd->hand_cold = clockpro_next(ps, slot);
+			continue;
+		}
+		if (!(values[slot] & CLOCKPRO_REFERENCED)) {
+			return slot;
+		}
+
+		if (values[slot] & CLOCKPRO_TEST) {
+			values[slot] = CLOCKPRO_HOT;
+			cd->num_cold--;
+			cd->num_hot++;
+		} else {
+			values[slot] = CLOCKPRO_TEST;
+		}
+		clockpro_move_to_head(ps, slot);
+		clockpro_balance(ps);
+	}
+}
+
+void clockpro_save(struct policy_simulation *ps, struct checkpoint *c) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	ghost_lists_save(&cd->ghosts, c);
+	checkpoint_write(c, &cd->hand_hot, sizeof(cd->hand_hot));
+	checkpoint_write(c, &cd->hand_cold, sizeof(cd->hand_cold));
+	checkpoint_write(c, &cd->num_hot, sizeof(cd->num_hot));
+	checkpoint_write(c, &cd->num_cold, sizeof(cd->num_cold));
+	checkpoint_write(c, &cd->cold_target, sizeof(cd->cold_target));
+}
+
+void clockpro_load(struct policy_simulation *ps, struct checkpoint *c) {
+	struct clockpro_data *cd = clockpro_data(ps);
+	ghost_lists_load(&cd->ghosts, c);
+	checkpoint_read(c, &cd->hand_hot, sizeof(cd->hand_hot));
+	checkpoint_read(c, &cd->hand_cold, sizeof(cd->hand_cold));
+	checkpoint_read(c, &cd->num_hot, sizeof(cd->num_hot));
+	checkpoint_read(c, &cd->num_cold, sizeof(cd->num_cold));
+	checkpoint_read(c, &cd->cold_target, sizeof(cd->cold_target));
+}
+
+// Gives ps, which must simulate opt_policy, the next use of every access
+// it will replay. Events must carry their trace position in seq.
+void opt_init(struct policy_simulation *ps, const struct next_use *next_use) {
+	struct opt_data *od = (struct opt_data *)malloc(sizeof(struct opt_data));
+	od->next_use = next_use;
+	od->heap_capacity = 1024;
+	od->heap = (struct opt_heap_item *)malloc(od->heap_capacity * sizeof(struct opt_heap_item));
+	od->heap_size = 0;
+	ps->policy_data = od;
+}
+
+void opt_heap_set(struct policy_simulation *ps, unsigned long i, struct opt_heap_item item) {
+	struct opt_data *od = ps->policy_data;
+	od->heap[i] = item;
+	ps->entries.values[item.slot] = i;
+}
+
+// Moves the item at i up or down until the heap is in order again
+void opt_heap_fix(struct policy_simulation *ps, unsigned long i) {
+	struct opt_data *od = ps->policy_data;
+	struct opt_heap_item item = od->heap[i];
+	while (i > 0 && od->heap[(i - 1) / 2].next_use < item.next_use) {
+		opt_heap_set(ps, i, od->heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	for (;;) {
+		unsigned long child = 2 * i + 1;
+		if (child >= od->heap_size) {
+			break;
+		}
+		if (child + 1 < od->heap_size && od->heap[child + 1].next_use > od->heap[child].next_use) {
+			child++;
+		}
+		if (od->heap[child].next_use <= item.next_use) {
+			break;
+		}
+		opt_heap_set(ps, i, od->heap[child]);
+		i = child;
+	}
+	opt_heap_set(ps, i, item);
+}
+
+void opt_hit_update(struct policy_simulation *ps, uint32_t hit_slot) {
+	struct opt_data *od = ps->policy_data;
+	uint32_t i = ps->entries.values[hit_slot];
+	od->heap[i].next_use = next_use_get(od->next_use, ps->event->seq);
+	opt_heap_fix(ps, i);
+}
+
+void opt_miss_update(struct policy_simulation *ps, unsigned long folio) {
+	struct opt_data *od = ps->policy_data;
+	uint32_t slot = policy_simulation_new_entry(ps, folio);
+
+	// list_head order doesn't matter to OPT, it only holds the resident slots
+	list_append(ps, slot);
+	if (od->heap_size == od->heap_capacity) {
+		od->heap_capacity *= 2;
+		od->heap = (struct opt_heap_item *)realloc(od->heap, od->heap_capacity * sizeof(struct opt_heap_item));
+	}
+	struct opt_heap_item item = { next_use_get(od->next_use, ps->event->seq), slot };
+	opt_heap_set(ps, od->heap_size++, item);
+	opt_heap_fix(ps, od->heap_size - 1);
+}
+
+void opt_evict_update(struct policy_simulation *ps, uint32_t evict_slot) {
+	struct opt_data *od = ps->policy_data;
+	unsigned long i = ps->entries.values[evict_slot];
+	od->heap_size--;
+	if (i < od->heap_size) {
+		opt_heap_set(ps, i, od->heap[od->heap_size]);
+		opt_heap_fix(ps, i);
+	}
+}
+
+uint32_t opt_victim(struct policy_simulation *ps) {
+	struct opt_data *od = ps->policy_data;
+	return od->heap[0].slot;
+}
+
+/*
+ * Defines prefix_policy from its hooks, NULL for the optional ones, along
+ * with a replay loop instantiated for exactly those hooks. Policies added
+ * elsewhere, e.g. as plugins, fill in struct policy by hand and leave
+ * track_accesses NULL.
+ */
+#define POLICY(prefix, policy_name, hit, miss, repeat, evict, victim_hook, save_hook, load_hook) \
+	static void prefix##_track_accesses(struct policy_simulation *ps, const struct event *events, unsigned long num_events) { \
+		for (unsigned long i = 0; i < num_events; i++) { \
+			track_access_inline(ps, &events[i], hit, miss, repeat, evict, victim_hook); \
+		} \
+	} \
+	const struct policy prefix##_policy = { \
+		.name = policy_name, \
+		.hit_update = hit, \
+		.miss_update = miss, \
+		.repeat_update = repeat, \
+		.evict_update = evict, \
+		.victim = victim_hook, \
+		.save = save_hook, \
+		.load = load_hook, \
+		.track_accesses = &prefix##_track_accesses, \
+	};
+
+POLICY(fifo, "FIFO", &fifo_hit_update, &fifo_miss_update, NULL, NULL, NULL, NULL, NULL)
+POLICY(lfu, "LFU", &lfu_hit_update, &lfu_miss_update, &lfu_repeat_update, &lfu_evict_update, NULL, &lfu_save, &lfu_load)
+POLICY(lru, "LRU", &lru_hit_update, &lru_miss_update, NULL, NULL, NULL, NULL, NULL)
+POLICY(mru, "MRU", &mru_hit_update, &mru_miss_update, NULL, NULL, NULL, NULL, NULL)
+POLICY(linux, "Linux", &linux_hit_update, &linux_miss_update, &linux_repeat_update, &linux_evict_update, &linux_victim, &linux_save, &linux_load)
+POLICY(arc, "ARC", &arc_hit_update, &arc_miss_update, &arc_repeat_update, &arc_evict_update, &arc_victim, &arc_save, &arc_load)
+POLICY(twoq, "2Q", &twoq_hit_update, &twoq_miss_update, NULL, &twoq_evict_update, &twoq_victim, &twoq_save, &twoq_load)
+POLICY(clockpro, "CLOCK-Pro", &clockpro_hit_update, &clockpro_miss_update, NULL, &clockpro_evict_update, &clockpro_victim, &clockpro_save, &clockpro_load)
+POLICY(opt, "OPT", &opt_hit_update, &opt_miss_update, NULL, &opt_evict_update, &opt_victim, NULL, NULL)
+
+const struct policy *const policies[] = {
+	&fifo_policy,
+	&lfu_policy,
+	&lru_policy,
+	&mru_policy,
+	&linux_policy,
+	&arc_policy,
+	&twoq_policy,
+	&clockpro_policy,
+	NULL,
+};
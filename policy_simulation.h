@@ -1,48 +1,242 @@
 #ifndef POLICY_SIMULATION_H
 #define POLICY_SIMULATION_H
 
-#include <uthash.h>
+#include <stdint.h>
 #include "common.h"
+#include "next_use.h"
+#include "folio_table.h"
+#include "checkpoint.h"
 
 
-struct list_entry {
-	struct list_entry *prev;
-	struct list_entry *next;
-	unsigned long folio;
-	void *payload;
-};
-
-struct task_stats_entry {
-	struct task_key key;
+struct task_stats {
 	unsigned long hits;
 	unsigned long misses;
-	UT_hash_handle hh;
 };
 
-struct policy_simulation {
-	struct list_entry *list_head;
-	struct task_stats_entry *task_stats;
-	void (*hit_update)(struct policy_simulation *, struct list_entry *);
+struct policy_simulation;
+
+struct policy {
+	const char *name;
+	void (*hit_update)(struct policy_simulation *, uint32_t);
 	void (*miss_update)(struct policy_simulation *, unsigned long);
+	// Optional. Called after hit_update or miss_update when the event stands
+	// for more than one access, with the number of extra accesses. Policies
+	// that don't change on a repeated access to the folio just touched leave it NULL.
+	void (*repeat_update)(struct policy_simulation *, uint32_t, unsigned long);
+	// Optional. Called on a slot right before it is unlinked from list_head and freed
+	void (*evict_update)(struct policy_simulation *, uint32_t);
+	// Optional. Picks the slot to evict, the head of list_head if NULL
+	uint32_t (*victim)(struct policy_simulation *);
+	// Optional. Write policy_data to a checkpoint and read it back into a new
+	// simulation. A policy with policy_data but no save can't be checkpointed.
+	void (*save)(struct policy_simulation *, struct checkpoint *);
+	void (*load)(struct policy_simulation *, struct checkpoint *);
+	// Optional. Replays a run of accesses with the hooks above inlined, see
+	// policy_simulation_track_accesses. NULL replays through the hooks.
+	void (*track_accesses)(struct policy_simulation *, const struct event *, unsigned long);
+};
+
+struct policy_simulation {
+	// Resident folios. Policies keep their per-folio state in entries.values.
+	struct folio_table entries;
+	// First slot of the resident folios in eviction order, linked through
+	// entries.prev and entries.next; policy_simulation_evict pops the head
+	uint32_t list_head;
+	// Per-task counts indexed by event task_id, grown as new ids show up
+	struct task_stats *task_stats;
+	unsigned int num_task_stats;
+	const struct policy *policy;
+	// Policy specific state, NULL until the policy sets it
+	void *policy_data;
+	// Maximum number of resident folios, 0 if unbounded
+	unsigned long capacity;
 	unsigned long hits;
 	unsigned long misses;
+	// The access being replayed, for policies that need more than its folio.
+	// Only valid inside the policy hooks.
+	const struct event *event;
 };
 
+// LFU's buckets, one per access count with resident folios, as arrays
+// indexed by bucket number. entries.values holds each slot's bucket.
+struct lfu_data {
+	// Buckets in ascending count order, linked through prev and next
+	uint32_t head;
+	uint32_t *prev;
+	uint32_t *next;
+	unsigned long *counts;
+	// First slot of each bucket's run in list_head
+	uint32_t *first;
+	uint32_t num_buckets;
+	// Unused buckets, chained through next
+	uint32_t free_buckets;
+};
+
+// OPT keeps resident folios in a max-heap on the position of their next
+// access, so the folio needed furthest in the future is always on top.
+// entries.values holds each slot's index in the heap.
+struct opt_heap_item {
+	unsigned long next_use;
+	uint32_t slot;
+};
+
+struct opt_data {
+	const struct next_use *next_use;
+	struct opt_heap_item *heap;
+	unsigned long heap_size;
+	unsigned long heap_capacity;
+};
+
+// Linux keeps list_head as the inactive list followed by the active list,
+// each from oldest to newest, so the head is the next folio reclaim takes.
+// entries.values holds the LINUX_ACTIVE and LINUX_REFERENCED flags.
+#define LINUX_ACTIVE 1
+#define LINUX_REFERENCED 2
+
+struct linux_lru_data {
+	// Oldest active slot, SLOT_NONE if the active list is empty
+	uint32_t first_active;
+	unsigned long num_active;
+	unsigned long num_inactive;
+	// inactive_ratio for a cache of gb GB, recomputed when gb changes
+	unsigned long gb;
+	unsigned long inactive_ratio;
+};
+
+
+// Folios a policy remembers after evicting them, in up to two lists, each
+// from oldest to newest. Bounded by the policy. table.values holds the list
+// each ghost is on.
+struct ghost_lists {
+	struct folio_table table;
+	uint32_t lists[2];
+	unsigned long sizes[2];
+};
+
+// ARC keeps list_head as T1 followed by T2, each from LRU to MRU. Ghosts of
+// T1 go to B1 (list 0) and ghosts of T2 to B2 (list 1).
+#define ARC_T2 1
+
+struct arc_data {
+	struct ghost_lists ghosts;
+	// LRU slot of T2, SLOT_NONE if T2 is empty
+	uint32_t first_t2;
+	unsigned long num_t1;
+	unsigned long num_t2;
+	// Target size of T1
+	unsigned long p;
+	// Set when the victim hook already adapted p for the access being replayed
+	int adapted;
+	// Set when the victim hook picked a slot that shouldn't leave a ghost
+	int no_ghost;
+};
+
+// 2Q keeps list_head as A1in, oldest first, followed by Am, from LRU to MRU.
+// A1out is ghost list 0.
+#define TWOQ_AM 1
+
+struct twoq_data {
+	struct ghost_lists ghosts;
+	// LRU slot of Am, SLOT_NONE if Am is empty
+	uint32_t first_am;
+	unsigned long num_a1in;
+	unsigned long num_am;
+};
+
+// CLOCK-Pro keeps resident folios in list_head as a clock, read from the
+// end back to the start. Non-resident cold folios in their test period are
+// ghost list 0. entries.values holds the CLOCKPRO_* flags.
+#define CLOCKPRO_HOT 1
+#define CLOCKPRO_REFERENCED 2
+#define CLOCKPRO_TEST 4
+
+struct clockpro_data {
+	struct ghost_lists ghosts;
+	// SLOT_NONE when list_head is empty
+	uint32_t hand_hot;
+	uint32_t hand_cold;
+	unsigned long num_hot;
+	unsigned long num_cold;
+	// Target number of resident cold folios
+	unsigned long cold_target;
+};
+
+
+extern const struct policy fifo_policy;
+extern const struct policy lfu_policy;
+extern const struct policy lru_policy;
+extern const struct policy mru_policy;
+extern const struct policy linux_policy;
+extern const struct policy arc_policy;
+extern const struct policy twoq_policy;
+extern const struct policy clockpro_policy;
+// Belady's OPT needs the whole trace up front, see opt_init. It is not in
+// policies, since it can't run on live events.
+extern const struct policy opt_policy;
+// NULL terminated list of every policy above but OPT
+extern const struct policy *const policies[];
 
-struct policy_simulation *policy_simulation_init(void (*hit_update)(struct policy_simulation *, struct list_entry *), void (*miss_update)(struct policy_simulation *, unsigned long));
+struct policy_simulation *policy_simulation_init(const struct policy *policy, unsigned long capacity);
+uint32_t policy_simulation_new_entry(struct policy_simulation *ps, unsigned long folio);
+void policy_simulation_free_entry(struct policy_simulation *ps, uint32_t slot);
+void policy_simulation_reserve_tasks(struct policy_simulation *ps, unsigned int max_task_id);
 void policy_simulation_track_access(struct policy_simulation *ps, const struct event *e);
+void policy_simulation_track_accesses(struct policy_simulation *ps, const struct event *events, unsigned long num_events, unsigned int max_task_id);
+void policy_simulation_remove_entry(struct policy_simulation *ps, uint32_t del_slot);
+void policy_simulation_remove(struct policy_simulation *ps, unsigned long folio);
+void policy_simulation_set_capacity(struct policy_simulation *ps, unsigned long capacity);
+void policy_simulation_scale_counts(struct policy_simulation *ps, double factor);
+void policy_simulation_evict_one(struct policy_simulation *ps);
 void policy_simulation_evict(struct policy_simulation *ps, unsigned long num_to_evict);
 float policy_simulation_total_hit_percent(struct policy_simulation *ps);
-float policy_simulation_task_hit_percent(struct policy_simulation *ps, const struct task_key *key);
+struct task_stats policy_simulation_task_stats(struct policy_simulation *ps, unsigned int task_id);
+float policy_simulation_task_hit_percent(struct policy_simulation *ps, unsigned int task_id);
 int policy_simulation_size(struct policy_simulation *ps);
 void policy_simulation_print(struct policy_simulation *ps);
-void fifo_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry);
+void policy_simulation_save(struct policy_simulation *ps, struct checkpoint *c);
+void policy_simulation_load(struct policy_simulation *ps, struct checkpoint *c);
+void fifo_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
 void fifo_miss_update(struct policy_simulation *ps, unsigned long folio);
-void lfu_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry);
+void lfu_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
 void lfu_miss_update(struct policy_simulation *ps, unsigned long folio);
-void lru_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry);
+void lfu_repeat_update(struct policy_simulation *ps, uint32_t slot, unsigned long repeats);
+void lfu_evict_update(struct policy_simulation *ps, uint32_t evict_slot);
+void lfu_save(struct policy_simulation *ps, struct checkpoint *c);
+void lfu_load(struct policy_simulation *ps, struct checkpoint *c);
+void lru_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
 void lru_miss_update(struct policy_simulation *ps, unsigned long folio);
-void mru_hit_update(struct policy_simulation *ps, struct list_entry *hit_entry);
+void mru_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
 void mru_miss_update(struct policy_simulation *ps, unsigned long folio);
+void linux_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
+void linux_miss_update(struct policy_simulation *ps, unsigned long folio);
+void linux_repeat_update(struct policy_simulation *ps, uint32_t slot, unsigned long repeats);
+void linux_evict_update(struct policy_simulation *ps, uint32_t evict_slot);
+uint32_t linux_victim(struct policy_simulation *ps);
+void linux_save(struct policy_simulation *ps, struct checkpoint *c);
+void linux_load(struct policy_simulation *ps, struct checkpoint *c);
+void arc_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
+void arc_miss_update(struct policy_simulation *ps, unsigned long folio);
+void arc_repeat_update(struct policy_simulation *ps, uint32_t slot, unsigned long repeats);
+void arc_evict_update(struct policy_simulation *ps, uint32_t evict_slot);
+uint32_t arc_victim(struct policy_simulation *ps);
+void arc_save(struct policy_simulation *ps, struct checkpoint *c);
+void arc_load(struct policy_simulation *ps, struct checkpoint *c);
+void twoq_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
+void twoq_miss_update(struct policy_simulation *ps, unsigned long folio);
+void twoq_evict_update(struct policy_simulation *ps, uint32_t evict_slot);
+uint32_t twoq_victim(struct policy_simulation *ps);
+void twoq_save(struct policy_simulation *ps, struct checkpoint *c);
+void twoq_load(struct policy_simulation *ps, struct checkpoint *c);
+void clockpro_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
+void clockpro_miss_update(struct policy_simulation *ps, unsigned long folio);
+void clockpro_evict_update(struct policy_simulation *ps, uint32_t evict_slot);
+uint32_t clockpro_victim(struct policy_simulation *ps);
+void clockpro_save(struct policy_simulation *ps, struct checkpoint *c);
+void clockpro_load(struct policy_simulation *ps, struct checkpoint *c);
+void opt_init(struct policy_simulation *ps, const struct next_use *next_use);
+void opt_hit_update(struct policy_simulation *ps, uint32_t hit_slot);
+void opt_miss_update(struct policy_simulation *ps, unsigned long folio);
+void opt_evict_update(struct policy_simulation *ps, uint32_t evict_slot);
+uint32_t opt_victim(struct policy_simulation *ps);
 
 #endif
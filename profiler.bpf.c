@@ -9,30 +9,217 @@
 char LICENSE[] SEC("license") = "Dual BSD/GPL";
 
 
+// Set by the profiler before loading: send events through per-CPU perf
+// buffers instead of the shared ring buffer
+const volatile bool per_cpu = false;
+
+// The profiler can resize this before loading
 struct {
 	__uint(type, BPF_MAP_TYPE_RINGBUF);
 	__uint(max_entries, 1200 * 1024 /* 1200 KB */);
 } events SEC(".maps");
 
-void send_event(unsigned long data, enum access_type type) {
-	struct event *e;
-	struct task_key key;
+struct {
+	__uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+	__uint(key_size, sizeof(u32));
+	__uint(value_size, sizeof(u32));
+} per_cpu_events SEC(".maps");
 
-	e = bpf_ringbuf_reserve(&events, sizeof(*e), 0);
-	if (!e) {
-		bpf_printk("bpf_ringbuf_reserve failed\n");
-		return;
+// Events that didn't fit in the buffer, per CPU
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, u32);
+	__type(value, u64);
+} drops SEC(".maps");
+
+// Set by the profiler before loading: fold repeated FMAs into weighted events
+const volatile bool dedup = false;
+
+// Per-CPU table of FMAs waiting to be sent, indexed by a hash of the folio.
+// An entry with count 0 is empty.
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(max_entries, DEDUP_SLOTS);
+	__type(key, u32);
+	__type(value, struct event);
+} pending SEC(".maps");
+
+// Set by the profiler before loading. Each enabled filter drops the events of
+// tasks that match none of its entries, a task has to pass all of them.
+const volatile bool filter_pids = false;
+const volatile bool filter_uids = false;
+const volatile bool filter_cgroups = false;
+const volatile struct comm_filter comm_filters[FILTER_MAX_COMMS] = {};
+const volatile u32 num_comm_filters = 0;
+
+// Filter sets, keyed by tgid, uid and cgroup ID
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, FILTER_MAX_ENTRIES);
+	__type(key, u32);
+	__type(value, u8);
+} pid_filter SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, FILTER_MAX_ENTRIES);
+	__type(key, u32);
+	__type(value, u8);
+} uid_filter SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, FILTER_MAX_ENTRIES);
+	__type(key, u64);
+	__type(value, u8);
+} cgroup_filter SEC(".maps");
+
+unsigned long next_seq = 0;
+
+// The helpers below are static, so the verifier checks them as part of each
+// kprobe and they can be passed its ctx
+static void count_drop(void) {
+	u32 zero = 0;
+	u64 *dropped = bpf_map_lookup_elem(&drops, &zero);
+	if (dropped) {
+		(*dropped)++;
+	}
+}
+
+// Sends e to userspace. Its seq must already be set, see assign_seq.
+static void emit_event(void *ctx, struct event *e) {
+	if (per_cpu) {
+		if (bpf_perf_event_output(ctx, &per_cpu_events, BPF_F_CURRENT_CPU, e, sizeof(*e))) {
+			count_drop();
+		}
+	} else if (bpf_ringbuf_output(&events, e, sizeof(*e), 0)) {
+		count_drop();
 	}
+}
 
-	key.uid = bpf_get_current_uid_gid();
-	key.pid = bpf_get_current_pid_tgid() >> 32;
-	bpf_get_current_comm(&key.command, 16);
+// Gives e the next sequence number. A folded FMA gets it when its first
+// access is folded, so even the pending FMAs the profiler drains at exit
+// carry one.
+static void assign_seq(struct event *e) {
+	e->seq = __sync_fetch_and_add(&next_seq, 1);
+}
 
-	e->data = data;
-	e->type = type;
-	e->key = key;
+static void flush_pending(void *ctx) {
+	for (u32 slot = 0; slot < DEDUP_SLOTS; slot++) {
+		struct event *p = bpf_map_lookup_elem(&pending, &slot);
+		if (p && p->count) {
+			emit_event(ctx, p);
+			p->count = 0;
+		}
+	}
+}
 
-	bpf_ringbuf_submit(e, 0);
+static bool comm_matches(const char *comm) {
+	for (u32 i = 0; i < FILTER_MAX_COMMS && i < num_comm_filters; i++) {
+		bool match = true;
+		for (u32 j = 0; j < sizeof(comm_filters[i].prefix) && j < comm_filters[i].len; j++) {
+			if (comm[j] != comm_filters[i].prefix[j]) {
+				match = false;
+				break;
+			}
+		}
+		if (match) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Checks the cheap filters first, so most filtered events never read their comm
+static bool task_matches(struct task_key *key) {
+	if (filter_pids && !bpf_map_lookup_elem(&pid_filter, &key->pid)) {
+		return false;
+	}
+	if (filter_uids && !bpf_map_lookup_elem(&uid_filter, &key->uid)) {
+		return false;
+	}
+	if (filter_cgroups) {
+		u64 cgroup = bpf_get_current_cgroup_id();
+		if (!bpf_map_lookup_elem(&cgroup_filter, &cgroup)) {
+			return false;
+		}
+	}
+	bpf_get_current_comm(&key->command, sizeof(key->command));
+	return !num_comm_filters || comm_matches(key->command);
+}
+
+// Task keys are compared as words, the command as two of them
+static bool same_task(const struct task_key *a, const struct task_key *b) {
+	const u64 *ac = (const u64 *)a->command;
+	const u64 *bc = (const u64 *)b->command;
+	return a->uid == b->uid && a->pid == b->pid && ac[0] == bc[0] && ac[1] == bc[1];
+}
+
+/*
+ * Repeated FMAs of a folio by the same task wait in the pending table and
+ * go out as one event with the number of accesses in count. A pending FMA is
+ * sent when its slot is needed for another folio or task, just before any
+ * other event for the same folio on the same CPU, and on every
+ * shrink_folio_list on the same CPU. The table is per CPU, and BPF programs
+ * can't lock one CPU's entries against another, so FMAs pending on other
+ * CPUs can go out after an eviction, and those of a CPU that goes idle stay
+ * pending until the profiler drains them at exit.
+ */
+static void send_event(void *ctx, unsigned long data, enum access_type type) {
+	struct event e = {};
+
+	e.data = data;
+	e.type = type;
+	e.count = 1;
+	// A folded FMA keeps the time and CPU of its first access
+	e.time = bpf_ktime_get_ns();
+	e.cpu = bpf_get_smp_processor_id();
+	e.key.uid = bpf_get_current_uid_gid();
+	e.key.pid = bpf_get_current_pid_tgid() >> 32;
+	// Reclaim is memory pressure on every task, so SFL always gets through
+	if (type == SFL) {
+		bpf_get_current_comm(&e.key.command, sizeof(e.key.command));
+	} else if (!task_matches(&e.key)) {
+		return;
+	}
+
+	if (!dedup) {
+		assign_seq(&e);
+		emit_event(ctx, &e);
+		return;
+	}
+	if (type == SFL) {
+		flush_pending(ctx);
+		assign_seq(&e);
+		emit_event(ctx, &e);
+		return;
+	}
+
+	u32 slot = ((data * 0x9e3779b97f4a7c15UL) >> 32) & (DEDUP_SLOTS - 1);
+	struct event *p = bpf_map_lookup_elem(&pending, &slot);
+	if (!p) {
+		assign_seq(&e);
+		emit_event(ctx, &e);
+		return;
+	}
+	if (p->count && p->folio == data) {
+		if (type == FMA && same_task(&p->key, &e.key)) {
+			p->count++;
+			return;
+		}
+		emit_event(ctx, p);
+		p->count = 0;
+	}
+	assign_seq(&e);
+	if (type == FMA) {
+		if (p->count) {
+			emit_event(ctx, p);
+		}
+		*p = e;
+		return;
+	}
+	emit_event(ctx, &e);
 }
 
 
@@ -42,7 +229,7 @@ int BPF_KPROBE(folio_mark_accessed, struct folio *folio)
 	pid_t pid;
 
 	pid = bpf_get_current_pid_tgid() >> 32;
-	send_event((unsigned long)folio, FMA);
+	send_event(ctx, (unsigned long)folio, FMA);
 	//bpf_printk("folio_mark_accessed: pid = %d\n", pid);
 
 	return 0;
@@ -55,7 +242,7 @@ int BPF_KPROBE(filemap_add_folio, struct address_space *mapping, struct folio *f
 	pid_t pid;
 
 	pid = bpf_get_current_pid_tgid() >> 32;
-	send_event((unsigned long)folio, FAF);
+	send_event(ctx, (unsigned long)folio, FAF);
 	//bpf_printk("filemap_add_folio: pid = %d\n", pid);
 
 	return 0;
@@ -73,7 +260,7 @@ int BPF_KPROBE(__folio_mark_dirty, struct folio *folio, struct address_space *ma
 
 	pid = bpf_get_current_pid_tgid() >> 32;
 	if (BPF_CORE_READ(folio, mapping)) {
-		send_event((unsigned long)folio, FMD);
+		send_event(ctx, (unsigned long)folio, FMD);
 		//bpf_printk("__folio_mark_dirty: pid = %d\n", pid);
 	}
 
@@ -94,8 +281,8 @@ int BPF_KPROBE(mark_buffer_dirty, struct buffer_head *bh)
 	 * b_folio pointer.
 	 */
 	folio = (struct folio *)BPF_CORE_READ(bh, b_page);
-	send_event((unsigned long)folio, MBD);
-	//send_event((unsigned long)30, SFL);
+	send_event(ctx, (unsigned long)folio, MBD);
+	//send_event(ctx, (unsigned long)30, SFL);
 	//bpf_printk("mark_buffer_dirty: pid = %d\n", pid);
 
 	return 0;
@@ -107,7 +294,7 @@ int BPF_KRETPROBE(shrink_folio_list, unsigned int ret)
 	pid_t pid;
 
 	pid = bpf_get_current_pid_tgid() >> 32;
-	send_event(ret, SFL);
+	send_event(ctx, ret, SFL);
 	//bpf_printk("shrink_folio_list: pid = %d, ret = %ld\n", pid, ret);
 
 	return 0;
@@ -11,28 +11,233 @@
 #include <bpf/libbpf.h>
 #include "profiler.skel.h"
 #include "common.h"
+#include "trace.h"
+#include "event_queue.h"
+#include "event_merge.h"
+#include "policy_simulation.h"
+#include "report.h"
+#include "live.h"
 #include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <sys/stat.h>
 #include <assert.h>
 #include <utlist.h>
 #include <uthash.h>
 
 
-FILE *log_file;
-unsigned long event_counter;
+struct profiler_opts {
+	bool c;
+	bool z;
+	bool P;
+	bool d;
+	// Size of the ring buffer, or of each per-CPU buffer with -P. 0 keeps the default.
+	unsigned long buffer_size;
+	// Most batches waiting for the writer before new ones are dropped, 0 for no limit
+	unsigned long max_unwritten;
+	// In-kernel filters, each unused while it is empty
+	unsigned int pids[FILTER_MAX_ENTRIES];
+	int num_pids;
+	unsigned int uids[FILTER_MAX_ENTRIES];
+	int num_uids;
+	unsigned long cgroups[FILTER_MAX_ENTRIES];
+	int num_cgroups;
+	struct comm_filter comms[FILTER_MAX_COMMS];
+	int num_comms;
+	// The filter flags as given, recorded in page.log
+	char filter[4096];
+	// Live simulation: the policies to run, at these capacities in folios
+	bool l;
+	bool N;
+	const struct policy *policies[16];
+	int num_policies;
+	unsigned long capacities[MAX_CAPACITIES];
+	int num_capacities;
+	double interval;
+};
 
 
+// How often the progress line is redrawn
+#define PROGRESS_INTERVAL_MS 1000
+#define PER_CPU_BUFFER_SIZE (256 * 1024)
+// 4 GB of batches waiting for the disk
+#define DEFAULT_MAX_UNWRITTEN 1024
+
+
+struct trace_writer *log_file;
+// Consumers of the event stream: the page.log writer and the live
+// simulation. Either can be NULL.
+struct event_queue *writer;
+struct event_queue *simulation;
+struct event_merge *merge;
+unsigned long events_received;
+// Sum of the events' counts, more than events_received when FMAs are folded
+unsigned long accesses_received;
+int num_cpus;
+uint64_t *dropped;
+// Events the writer dropped per CPU because too many batches were waiting
+// for the disk. read_drops adds them to the kernel's drops.
+uint64_t *write_dropped;
+// Unix time minus CLOCK_MONOTONIC in ns, to turn the times the BPF programs
+// record into times that line up with other logs
+unsigned long time_offset;
+
+
+// Formatting, disk writes and simulation all happen on consumer threads, so
+// the ring buffer is drained as fast as events can be copied out
+void dispatch_event(const struct event *e) {
+	if (writer) {
+		event_queue_push(writer, e);
+	}
+	if (simulation) {
+		event_queue_push(simulation, e);
+	}
+}
+
+void write_events(void *ctx, const struct event *events, unsigned long num_events) {
+	for (unsigned long i = 0; i < num_events; i++) {
+		struct event e = events[i];
+		e.time += time_offset;
+		trace_writer_write(log_file, &e);
+	}
+}
+
 int handle_event(void *ctx, void *data, size_t data_size) {
 	const struct event *e = data;
 
-	fprintf(log_file, "%lu,%d,%d,%d,%s\n", e->data, e->type, e->key.uid, e->key.pid, e->key.command);
-	printf("Events Logged: %-32lu\r", event_counter++);
-	fflush(stdout);
+	events_received++;
+	accesses_received += e->count;
+	dispatch_event(e);
 
-	//policy_simulation_track_access(ps, e);
+	return 0;
+}
+
+void handle_per_cpu_event(void *ctx, int cpu, void *data, __u32 data_size) {
+	const struct event *e = data;
+
+	events_received++;
+	accesses_received += e->count;
+	event_merge_push(merge, e);
+}
+
+void count_write_drops(void *ctx, const struct event *events, unsigned long num_events) {
+	for (unsigned long i = 0; i < num_events; i++) {
+		if (events[i].cpu < num_cpus) {
+			write_dropped[events[i].cpu]++;
+		}
+	}
+}
+
+// Reads the per-CPU drop counters into dropped, adds the writer's drops and
+// returns their total
+unsigned long read_drops(struct profiler_bpf *skel) {
+	__u32 zero = 0;
+	unsigned long total = 0;
+	if (bpf_map__lookup_elem(skel->maps.drops, &zero, sizeof(zero), dropped, num_cpus * sizeof(uint64_t), 0)) {
+		return 0;
+	}
+	for (int cpu = 0; cpu < num_cpus; cpu++) {
+		dropped[cpu] += write_dropped[cpu];
+		total += dropped[cpu];
+	}
+	return total;
+}
 
+// Sends the FMAs still waiting in every CPU's deduplication table. The BPF
+// programs must be detached first.
+void flush_pending(struct profiler_bpf *skel) {
+	struct event *pending = (struct event *)calloc(num_cpus, sizeof(struct event));
+	for (__u32 slot = 0; slot < DEDUP_SLOTS; slot++) {
+		if (bpf_map__lookup_elem(skel->maps.pending, &slot, sizeof(slot), pending, num_cpus * sizeof(struct event), 0)) {
+			continue;
+		}
+		for (int cpu = 0; cpu < num_cpus; cpu++) {
+			if (pending[cpu].count) {
+				events_received++;
+				accesses_received += pending[cpu].count;
+				dispatch_event(&pending[cpu]);
+			}
+		}
+	}
+	free(pending);
+}
+
+// Parses a comma separated list of policy names. Returns 0 on failure.
+int parse_policies(char *arg, struct profiler_opts *flags) {
+	for (char *name = strtok(arg, ","); name; name = strtok(NULL, ",")) {
+		int i = 0;
+		while (policies[i] && strcasecmp(policies[i]->name, name)) {
+			i++;
+		}
+		if (!policies[i] || flags->num_policies == sizeof(flags->policies) / sizeof(flags->policies[0])) {
+			return 0;
+		}
+		flags->policies[flags->num_policies++] = policies[i];
+	}
+	return 1;
+}
+
+// Appends the flag and its argument to the filter description in flags
+void describe_filter(struct profiler_opts *flags, const char *name, const char *arg) {
+	size_t len = strlen(flags->filter);
+	snprintf(flags->filter + len, sizeof(flags->filter) - len, "%s%s=%s", len ? " " : "", name, arg);
+}
+
+// Adds every id in a comma separated list to ids. Returns 0 on failure.
+int parse_ids(char *arg, unsigned int *ids, int *num_ids) {
+	for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		char *end;
+		unsigned long id = strtoul(tok, &end, 10);
+		if (*end || *num_ids == FILTER_MAX_ENTRIES) {
+			return 0;
+		}
+		ids[(*num_ids)++] = id;
+	}
+	return 1;
+}
+
+// Takes a cgroup ID or the path of a cgroup v2 directory, whose inode number
+// is its ID. Returns 0 on failure.
+unsigned long parse_cgroup(const char *arg) {
+	char *end;
+	unsigned long id = strtoul(arg, &end, 10);
+	if (*arg && !*end) {
+		return id;
+	}
+	struct stat st;
+	if (stat(arg, &st) || !S_ISDIR(st.st_mode)) {
+		return 0;
+	}
+	return st.st_ino;
+}
+
+// Loads the filter sets into the BPF maps, once the programs are loaded
+int load_filters(struct profiler_bpf *skel, struct profiler_opts *flags) {
+	__u8 one = 1;
+	for (int i = 0; i < flags->num_pids; i++) {
+		if (bpf_map__update_elem(skel->maps.pid_filter, &flags->pids[i], sizeof(flags->pids[i]), &one, sizeof(one), BPF_ANY)) {
+			return -1;
+		}
+	}
+	for (int i = 0; i < flags->num_uids; i++) {
+		if (bpf_map__update_elem(skel->maps.uid_filter, &flags->uids[i], sizeof(flags->uids[i]), &one, sizeof(one), BPF_ANY)) {
+			return -1;
+		}
+	}
+	for (int i = 0; i < flags->num_cgroups; i++) {
+		__u64 cgroup = flags->cgroups[i];
+		if (bpf_map__update_elem(skel->maps.cgroup_filter, &cgroup, sizeof(cgroup), &one, sizeof(one), BPF_ANY)) {
+			return -1;
+		}
+	}
 	return 0;
 }
 
+double elapsed_seconds(const struct timespec *start, const struct timespec *end) {
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
 static int libbpf_print_fn(enum libbpf_print_level level, const char *format, va_list args)
 {
 	return vfprintf(stderr, format, args);
@@ -48,19 +253,189 @@ static void sig_int(int signo)
 int main(int argc, char **argv)
 {
 	struct profiler_bpf *skel;
-	int err;
-	struct ring_buffer *rb;
+	int err = 0;
+	struct ring_buffer *rb = NULL;
+	struct perf_buffer *pb = NULL;
+	struct profiler_opts flags;
+	flags.c = false;
+	flags.z = false;
+	flags.P = false;
+	flags.d = false;
+	flags.buffer_size = 0;
+	flags.max_unwritten = DEFAULT_MAX_UNWRITTEN;
+	flags.num_pids = 0;
+	flags.num_uids = 0;
+	flags.num_cgroups = 0;
+	flags.num_comms = 0;
+	flags.filter[0] = '\0';
+	flags.l = false;
+	flags.N = false;
+	flags.num_policies = 0;
+	flags.num_capacities = 0;
+	flags.interval = 10;
+	int opt;
+	while ((opt = getopt(argc, argv, "czPdb:q:p:u:g:n:lNy:k:i:")) != -1) {
+		switch(opt) {
+			case 'c':
+				flags.c = true;
+				break;
+			case 'z':
+				flags.z = true;
+				break;
+			case 'P':
+				flags.P = true;
+				break;
+			case 'd':
+				flags.d = true;
+				break;
+			case 'b':
+				flags.buffer_size = parse_size(optarg);
+				if (!flags.buffer_size) {
+					printf("Invalid buffer size: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'q':
+				flags.max_unwritten = strtoul(optarg, NULL, 10);
+				break;
+			case 'p':
+				describe_filter(&flags, "pid", optarg);
+				if (!parse_ids(optarg, flags.pids, &flags.num_pids)) {
+					printf("Invalid pid list, at most %d pids: %s\n", FILTER_MAX_ENTRIES, optarg);
+					return 1;
+				}
+				break;
+			case 'u':
+				describe_filter(&flags, "uid", optarg);
+				if (!parse_ids(optarg, flags.uids, &flags.num_uids)) {
+					printf("Invalid uid list, at most %d uids: %s\n", FILTER_MAX_ENTRIES, optarg);
+					return 1;
+				}
+				break;
+			case 'g':
+				describe_filter(&flags, "cgroup", optarg);
+				if (flags.num_cgroups == FILTER_MAX_ENTRIES || !(flags.cgroups[flags.num_cgroups++] = parse_cgroup(optarg))) {
+					printf("Invalid cgroup: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'n':
+				describe_filter(&flags, "comm", optarg);
+				if (flags.num_comms == FILTER_MAX_COMMS) {
+					printf("At most %d command prefixes\n", FILTER_MAX_COMMS);
+					return 1;
+				}
+				struct comm_filter *comm = &flags.comms[flags.num_comms++];
+				memset(comm, 0, sizeof(*comm));
+				strncpy(comm->prefix, optarg, sizeof(comm->prefix) - 1);
+				comm->len = strlen(comm->prefix);
+				break;
+			case 'l':
+				flags.l = true;
+				break;
+			case 'N':
+				flags.N = true;
+				break;
+			case 'y':
+				if (!parse_policies(optarg, &flags)) {
+					printf("Invalid policy list: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'k':
+				if (parse_capacities(optarg, flags.capacities, &flags.num_capacities)) {
+					printf("Invalid capacity list: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'i':
+				flags.interval = strtod(optarg, NULL);
+				if (flags.interval <= 0) {
+					printf("Interval must be positive\n");
+					return 1;
+				}
+				break;
+			case '?':
+				printf("Usage: %s [-c | -z] [-P] [-d] [-b size] [-q batches] [-p pids] [-u uids] [-g cgroup] [-n comm] [-l [-y policies] [-k capacities] [-i seconds] [-N]]\n", argv[0]);
+				printf("-c: Write page.log as CSV instead of the binary trace format\n");
+				printf("-z: Write page.log in the compact trace format instead of the binary trace format\n");
+				printf("-P: Send events through per-CPU buffers instead of one shared ring buffer\n");
+				printf("-d: Fold repeated FMAs of a folio by the same task into one weighted event in the kernel\n");
+				printf("-b: Size of the ring buffer, or of each per-CPU buffer with -P, in bytes with an optional K, M or G suffix\n");
+				printf("-q: Most batches of %d events waiting to be written before new ones are dropped, 0 for no limit (default %d)\n", EVENT_BATCH_SIZE, DEFAULT_MAX_UNWRITTEN);
+				printf("-p: Only record processes with these comma separated pids\n");
+				printf("-u: Only record tasks with these comma separated uids\n");
+				printf("-g: Only record tasks in this cgroup, given as a cgroup v2 directory or ID\n");
+				printf("-n: Only record tasks whose command starts with this prefix\n");
+				printf("-p, -u, -g and -n can be repeated. A task must match every kind of filter given.\n");
+				printf("-l: Simulate policies on the events as they arrive and print hit %% tables\n");
+				printf("-y: Comma separated policies to simulate with -l, e.g. LRU,LFU (default all)\n");
+				printf("-k: Cache sizes to simulate with -l, as for the simulator's -c (default unbounded)\n");
+				printf("-i: Seconds between hit %% tables with -l (default 10)\n");
+				printf("-N: Don't write page.log, only simulate with -l\n");
+				return 1;
+		}
+	}
+	if (flags.c && flags.z) {
+		printf("-c and -z can't be used together\n");
+		return 1;
+	}
+	if (flags.N && !flags.l) {
+		printf("-N needs -l\n");
+		return 1;
+	}
+	if (flags.l && !flags.num_policies) {
+		while (policies[flags.num_policies]) {
+			flags.policies[flags.num_policies] = policies[flags.num_policies];
+			flags.num_policies++;
+		}
+	}
 
 	/* Set up libbpf errors and debug info callback */
 	libbpf_set_print(libbpf_print_fn);
 
-	/* Open load and verify BPF application */
-	skel = profiler_bpf__open_and_load();
+	/* Open BPF application */
+	skel = profiler_bpf__open();
 	if (!skel) {
 		fprintf(stderr, "Failed to open BPF skeleton\n");
 		return 1;
 	}
 
+	/* Pick the event transport, which is fixed once the programs are loaded */
+	skel->rodata->per_cpu = flags.P;
+	skel->rodata->dedup = flags.d;
+
+	/* Enable the filters that were asked for */
+	skel->rodata->filter_pids = flags.num_pids > 0;
+	skel->rodata->filter_uids = flags.num_uids > 0;
+	skel->rodata->filter_cgroups = flags.num_cgroups > 0;
+	memcpy((void *)skel->rodata->comm_filters, flags.comms, sizeof(flags.comms));
+	skel->rodata->num_comm_filters = flags.num_comms;
+	if (flags.P) {
+		// The ring buffer goes unused, keep it as small as it can be
+		err = bpf_map__set_max_entries(skel->maps.events, getpagesize());
+	} else if (flags.buffer_size) {
+		// libbpf rounds this up to a power of two number of pages
+		err = bpf_map__set_max_entries(skel->maps.events, flags.buffer_size);
+	}
+	if (err) {
+		fprintf(stderr, "Failed to size ring buffer\n");
+		goto cleanup;
+	}
+
+	/* Load and verify BPF programs */
+	err = profiler_bpf__load(skel);
+	if (err) {
+		fprintf(stderr, "Failed to load and verify BPF skeleton\n");
+		goto cleanup;
+	}
+
+	err = load_filters(skel, &flags);
+	if (err) {
+		fprintf(stderr, "Failed to load filters\n");
+		goto cleanup;
+	}
+
 	/* Attach tracepoint handler */
 	err = profiler_bpf__attach(skel);
 	if (err) {
@@ -73,37 +448,160 @@ int main(int argc, char **argv)
 		goto cleanup;
 	}
 
-	/* Set up ring buffer polling */
-	rb = ring_buffer__new(bpf_map__fd(skel->maps.events), handle_event, NULL, NULL);
-	if (!rb) {
-		err = -1;
-		fprintf(stderr, "Failed to create ring buffer\n");
-		goto cleanup;
+	if (flags.P) {
+		/* Set up per-CPU buffer polling, perf buffers are sized in pages */
+		unsigned long page_cnt = 1;
+		unsigned long buffer_size = flags.buffer_size ? flags.buffer_size : PER_CPU_BUFFER_SIZE;
+		while (page_cnt * getpagesize() < buffer_size) {
+			page_cnt *= 2;
+		}
+		pb = perf_buffer__new(bpf_map__fd(skel->maps.per_cpu_events), page_cnt, handle_per_cpu_event, NULL, NULL, NULL);
+		if (!pb) {
+			err = -1;
+			fprintf(stderr, "Failed to create per-CPU buffers\n");
+			goto cleanup;
+		}
+		merge = event_merge_init(dispatch_event);
+	} else {
+		/* Set up ring buffer polling */
+		rb = ring_buffer__new(bpf_map__fd(skel->maps.events), handle_event, NULL, NULL);
+		if (!rb) {
+			err = -1;
+			fprintf(stderr, "Failed to create ring buffer\n");
+			goto cleanup;
+		}
 	}
 
 	printf("Successfully started! Please run `sudo cat /sys/kernel/debug/tracing/trace_pipe` "
 	       "to see output of the BPF programs.\n");
 
 	printf("\n");
-	event_counter = 0;
-	log_file = fopen("page.log", "w");
+	num_cpus = libbpf_num_possible_cpus();
+	dropped = (uint64_t *)calloc(num_cpus, sizeof(uint64_t));
+	write_dropped = (uint64_t *)calloc(num_cpus, sizeof(uint64_t));
+	if (!flags.N) {
+		struct timespec realtime, monotonic;
+		clock_gettime(CLOCK_REALTIME, &realtime);
+		clock_gettime(CLOCK_MONOTONIC, &monotonic);
+		time_offset = (realtime.tv_sec - monotonic.tv_sec) * 1000000000L + (realtime.tv_nsec - monotonic.tv_nsec);
+		log_file = trace_writer_open("page.log", flags.c ? TRACE_CSV : flags.z ? TRACE_COMPACT : TRACE_BINARY, num_cpus, flags.filter);
+		if (!log_file) {
+			err = -1;
+			fprintf(stderr, "Failed to open log file\n");
+			goto cleanup;
+		}
+		// Only skips events when the disk can't keep up for so long that the
+		// backlog would run out of memory. They are counted as drops.
+		writer = event_queue_init(write_events, NULL, flags.max_unwritten);
+		writer->on_drop = count_write_drops;
+	}
+	struct live_simulation *live = NULL;
+	if (flags.l) {
+		live = live_init(flags.policies, flags.num_policies, flags.capacities, flags.num_capacities, flags.interval);
+		// Skips events rather than let the simulation hold up the ring buffer
+		simulation = event_queue_init(live_consume, live, LIVE_MAX_QUEUED);
+		live->queue = simulation;
+	}
+
+	struct timespec start, last_progress, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	last_progress = start;
+	unsigned long last_received = 0;
+	events_received = 0;
+	accesses_received = 0;
 	while (!stop) {
 		const int timeout_ms = 100;
-		err = ring_buffer__poll(rb, timeout_ms);
+		if (pb) {
+			err = perf_buffer__poll(pb, timeout_ms);
+			if (err >= 0) {
+				event_merge_end_round(merge);
+			}
+		} else {
+			err = ring_buffer__poll(rb, timeout_ms);
+		}
 		/* Ctrl-C will cause -EINTR */
 		if (err == -EINTR) {
 			err = 0;
 			break;
 		}
 		if (err < 0) {
-			printf("Error polling ring buffer: %d\n", err);
+			printf("Error polling %s: %d\n", pb ? "per-CPU buffers" : "ring buffer", err);
 			break;
 		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double interval = elapsed_seconds(&last_progress, &now);
+		if (interval * 1000 >= PROGRESS_INTERVAL_MS) {
+			// The live tables are printed from the simulation's thread
+			if (live) {
+				pthread_mutex_lock(&live->print_lock);
+			}
+			printf("Events Received: %-16lu Logged: %-16lu Dropped: %-12lu Rate: %-12.0f events/sec\r",
+			       events_received, writer ? event_queue_consumed(writer) : 0, read_drops(skel), (events_received - last_received) / interval);
+			fflush(stdout);
+			if (live) {
+				pthread_mutex_unlock(&live->print_lock);
+			}
+			// Keeps the live tables current when events trickle in
+			if (simulation) {
+				event_queue_flush(simulation);
+			}
+			last_progress = now;
+			last_received = events_received;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = elapsed_seconds(&start, &now);
+
+	/* Stop new events, then collect everything still in flight */
+	profiler_bpf__detach(skel);
+	if (pb) {
+		perf_buffer__consume(pb);
+		event_merge_flush(merge);
+	} else {
+		ring_buffer__consume(rb);
+	}
+	if (flags.d) {
+		flush_pending(skel);
+	}
+	unsigned long total_dropped = read_drops(skel);
+	printf("\n");
+	if (simulation) {
+		event_queue_finish(simulation);
+		live_print(live);
+		printf("\n");
+	}
+	if (writer) {
+		event_queue_finish(writer);
+		trace_writer_set_dropped(log_file, dropped);
+		trace_writer_close(log_file);
+		printf("Events Logged: %lu in %.2fs (%.0f events/sec)\n", writer->num_consumed, elapsed, writer->num_consumed / elapsed);
+		printf("Peak Backlog: %lu batches of %d events\n", writer->peak_queued, EVENT_BATCH_SIZE);
+	} else {
+		printf("Events Received: %lu in %.2fs (%.0f events/sec)\n", events_received, elapsed, events_received / elapsed);
+	}
+	if (flags.d) {
+		printf("Accesses Received: %lu (%.1f per event)\n", accesses_received, events_received ? (double)accesses_received / events_received : 0.0);
+	}
+	printf("Events Dropped: %lu\n", total_dropped);
+	for (int cpu = 0; cpu < num_cpus; cpu++) {
+		if (dropped[cpu]) {
+			printf("    CPU %-4d %lu\n", cpu, (unsigned long)dropped[cpu]);
+		}
+	}
+	if (merge && merge->num_late) {
+		printf("Events Out of Order: %lu\n", merge->num_late);
+	}
+	if (simulation) {
+		event_queue_destroy(simulation);
+	}
+	if (writer) {
+		event_queue_destroy(writer);
 	}
-	fclose(log_file);
-	printf("Events Logged: %-32lu\n", event_counter);
 
 cleanup:
+	ring_buffer__free(rb);
+	perf_buffer__free(pb);
 	profiler_bpf__destroy(skel);
 	return -err;
 }
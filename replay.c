@@ -0,0 +1,204 @@
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "sampler.h"
+
+
+struct replay_worker_args {
+	struct replay *r;
+	int id;
+};
+
+
+void replay_apply(struct replay *r, int i, const struct replay_item *item) {
+	struct policy_simulation *ps = r->sims[i];
+	switch (item->op) {
+		case REPLAY_ACCESS:
+			// Batched apart from the other items, see replay_apply_batch
+			break;
+		case REPLAY_EVICT:
+			policy_simulation_evict(ps, item->num_evicted);
+			break;
+		case REPLAY_REMOVE:
+			policy_simulation_remove(ps, item->folio);
+			break;
+		case REPLAY_RESCALE:
+			if (r->capacities[i]) {
+				policy_simulation_set_capacity(ps, sampler_capacity(r->capacities[i], item->rate));
+			}
+			policy_simulation_scale_counts(ps, item->rate_change);
+			break;
+	}
+}
+
+// Replays a batch through simulation i, each run of accesses in one call
+void replay_apply_batch(struct replay *r, int i, const struct replay_batch *batch) {
+	struct policy_simulation *ps = r->sims[i];
+	int start = 0;
+	for (int j = 0; j < batch->num_items; j++) {
+		const struct replay_item *item = &batch->items[j];
+		policy_simulation_track_accesses(ps, batch->events + start, item->position - start, batch->max_task_id);
+		start = item->position;
+		replay_apply(r, i, item);
+	}
+	policy_simulation_track_accesses(ps, batch->events + start, batch->num_events - start, batch->max_task_id);
+}
+
+void *replay_worker(void *arg) {
+	struct replay_worker_args *args = arg;
+	struct replay *r = args->r;
+
+	for (unsigned long b = 0;; b++) {
+		pthread_mutex_lock(&r->lock);
+		while (r->produced <= b && !r->done) {
+			pthread_cond_wait(&r->batch_ready, &r->lock);
+		}
+		if (r->produced <= b) {
+			pthread_mutex_unlock(&r->lock);
+			break;
+		}
+		pthread_mutex_unlock(&r->lock);
+
+		// The batch can't be refilled until pending drops to 0, so it is safe to read unlocked
+		struct replay_batch *batch = &r->batches[b % REPLAY_QUEUE_DEPTH];
+		for (int i = args->id; i < r->num_sims; i += r->num_workers) {
+			replay_apply_batch(r, i, batch);
+		}
+
+		pthread_mutex_lock(&r->lock);
+		if (--batch->pending == 0) {
+			pthread_cond_signal(&r->batch_free);
+		}
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	free(args);
+	return NULL;
+}
+
+struct replay *replay_init(struct policy_simulation **sims, int num_sims, unsigned long *capacities, int num_workers) {
+	struct replay *r = (struct replay *)malloc(sizeof(struct replay));
+	r->sims = sims;
+	r->num_sims = num_sims;
+	r->capacities = capacities;
+	r->num_workers = num_workers < num_sims ? num_workers : num_sims;
+	r->workers = NULL;
+	r->produced = 0;
+	r->done = 0;
+	if (!r->num_workers) {
+		r->batches = (struct replay_batch *)calloc(1, sizeof(struct replay_batch));
+		return r;
+	}
+
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->batch_ready, NULL);
+	pthread_cond_init(&r->batch_free, NULL);
+	r->batches = (struct replay_batch *)calloc(REPLAY_QUEUE_DEPTH, sizeof(struct replay_batch));
+	r->workers = (pthread_t *)malloc(r->num_workers * sizeof(pthread_t));
+	for (int i = 0; i < r->num_workers; i++) {
+		struct replay_worker_args *args = (struct replay_worker_args *)malloc(sizeof(struct replay_worker_args));
+		args->r = r;
+		args->id = i;
+		pthread_create(&r->workers[i], NULL, replay_worker, args);
+	}
+	return r;
+}
+
+// Hands the batch being filled to the workers
+void replay_publish(struct replay *r) {
+	pthread_mutex_lock(&r->lock);
+	r->batches[r->produced % REPLAY_QUEUE_DEPTH].pending = r->num_workers;
+	r->produced++;
+	pthread_cond_broadcast(&r->batch_ready);
+	pthread_mutex_unlock(&r->lock);
+}
+
+// Applies the batch being filled to every simulation, without workers
+void replay_flush(struct replay *r) {
+	struct replay_batch *batch = &r->batches[0];
+	for (int i = 0; i < r->num_sims; i++) {
+		replay_apply_batch(r, i, batch);
+	}
+	batch->num_events = 0;
+	batch->num_items = 0;
+	batch->max_task_id = 0;
+}
+
+// Publishes the batch being filled and starts the next one, once the
+// slowest worker is done with the slot it goes in
+void replay_advance(struct replay *r) {
+	replay_publish(r);
+
+	struct replay_batch *next = &r->batches[r->produced % REPLAY_QUEUE_DEPTH];
+	pthread_mutex_lock(&r->lock);
+	while (next->pending) {
+		pthread_cond_wait(&r->batch_free, &r->lock);
+	}
+	pthread_mutex_unlock(&r->lock);
+	next->num_events = 0;
+	next->num_items = 0;
+	next->max_task_id = 0;
+}
+
+void replay_push(struct replay *r, const struct replay_item *item) {
+	struct replay_batch *batch = &r->batches[r->num_workers ? r->produced % REPLAY_QUEUE_DEPTH : 0];
+	if (item->op == REPLAY_ACCESS) {
+		batch->events[batch->num_events++] = item->e;
+		if (item->e.type != SFL && item->e.task_id > batch->max_task_id) {
+			batch->max_task_id = item->e.task_id;
+		}
+	} else {
+		batch->items[batch->num_items] = *item;
+		batch->items[batch->num_items++].position = batch->num_events;
+	}
+	if (batch->num_events < REPLAY_BATCH_SIZE && batch->num_items < REPLAY_BATCH_SIZE) {
+		return;
+	}
+
+	if (!r->num_workers) {
+		replay_flush(r);
+		return;
+	}
+	replay_advance(r);
+}
+
+// Returns once every item pushed so far has been applied to every
+// simulation, so their counts can be read. Replay carries on after it.
+void replay_sync(struct replay *r) {
+	if (!r->num_workers) {
+		replay_flush(r);
+		return;
+	}
+
+	struct replay_batch *batch = &r->batches[r->produced % REPLAY_QUEUE_DEPTH];
+	if (batch->num_events || batch->num_items) {
+		replay_advance(r);
+	}
+	pthread_mutex_lock(&r->lock);
+	for (int b = 0; b < REPLAY_QUEUE_DEPTH; b++) {
+		while (r->batches[b].pending) {
+			pthread_cond_wait(&r->batch_free, &r->lock);
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+// Flushes any partial batch and waits for the workers to consume everything
+void replay_finish(struct replay *r) {
+	if (!r->num_workers) {
+		replay_flush(r);
+		return;
+	}
+
+	struct replay_batch *batch = &r->batches[r->produced % REPLAY_QUEUE_DEPTH];
+	if (batch->num_events || batch->num_items) {
+		replay_publish(r);
+	}
+	pthread_mutex_lock(&r->lock);
+	r->done = 1;
+	pthread_cond_broadcast(&r->batch_ready);
+	pthread_mutex_unlock(&r->lock);
+	for (int i = 0; i < r->num_workers; i++) {
+		pthread_join(r->workers[i], NULL);
+	}
+}
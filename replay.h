@@ -0,0 +1,83 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <pthread.h>
+#include "common.h"
+#include "policy_simulation.h"
+
+#define REPLAY_BATCH_SIZE 4096
+// Batches in flight between the reader and the workers, bounds replay memory
+#define REPLAY_QUEUE_DEPTH 8
+
+
+// Everything the simulations see, in trace order
+enum replay_op {
+	REPLAY_ACCESS,
+	REPLAY_EVICT,
+	REPLAY_REMOVE,
+	REPLAY_RESCALE,
+};
+
+struct replay_item {
+	enum replay_op op;
+	// Set by replay_push for everything but REPLAY_ACCESS: the number of
+	// accesses in the batch that come before this item
+	int position;
+	union {
+		// REPLAY_ACCESS
+		struct event e;
+		// REPLAY_EVICT
+		unsigned long num_evicted;
+		// REPLAY_REMOVE
+		unsigned long folio;
+		// REPLAY_RESCALE: the sampling rate went down by rate_change to rate
+		struct {
+			double rate_change;
+			double rate;
+		};
+	};
+};
+
+// Accesses are kept apart from the other items, so each simulation can
+// replay the runs between those in one call to its specialized loop
+struct replay_batch {
+	struct event events[REPLAY_BATCH_SIZE];
+	int num_events;
+	// Largest task id of the accesses, so task stats are sized once per batch
+	unsigned int max_task_id;
+	struct replay_item items[REPLAY_BATCH_SIZE];
+	int num_items;
+	// Workers that have yet to consume this batch
+	int pending;
+};
+
+/*
+ * Feeds a stream of replay_items to a set of simulations in batches. With no
+ * workers each full batch is applied to every simulation in turn. Otherwise
+ * every worker reads the batches in order, applying them to its own share of
+ * the simulations. Simulations share no state, so the results are the same
+ * either way.
+ */
+struct replay {
+	struct policy_simulation **sims;
+	int num_sims;
+	// Unscaled capacity of each simulation, for REPLAY_RESCALE
+	unsigned long *capacities;
+	int num_workers;
+	pthread_t *workers;
+	struct replay_batch *batches;
+	// Batches handed to the workers so far
+	unsigned long produced;
+	int done;
+	pthread_mutex_t lock;
+	pthread_cond_t batch_ready;
+	pthread_cond_t batch_free;
+};
+
+
+struct replay *replay_init(struct policy_simulation **sims, int num_sims, unsigned long *capacities, int num_workers);
+void replay_push(struct replay *r, const struct replay_item *item);
+void replay_sync(struct replay *r);
+void replay_finish(struct replay *r);
+
+#endif
@@ -0,0 +1,242 @@
+#include "report.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+float calculate_linux_hit_percent(unsigned long fma, unsigned long faf, unsigned long fmd, unsigned long mbd) {
+	// total = total cache accesses without counting dirties
+	// misses = total of add to lru because of read misses
+	float total = (float)fma - (float)mbd;
+	float misses = (float)faf - (float)fmd;
+	if (misses < 0)
+		misses = 0;
+	if (total < 0)
+		total = 0;
+	float hits = total - misses;
+	if (hits < 0) {
+		misses = total;
+		hits = 0;
+	}
+	return 100.0 * (hits / total);
+}
+
+struct linux_stats *linux_stats_init(void) {
+	struct linux_stats *ls = (struct linux_stats *)malloc(sizeof(struct linux_stats));
+	ls->tasks = task_table_init();
+	ls->num_task_stats = ls->tasks->size;
+	ls->task_stats = (struct linux_task_stats *)calloc(ls->num_task_stats, sizeof(struct linux_task_stats));
+	ls->fma = ls->faf = ls->fmd = ls->mbd = 0;
+	return ls;
+}
+
+// Assigns e its task_id and counts it
+void linux_stats_track(struct linux_stats *ls, struct event *e) {
+	// Only accesses are attributed to a task, so SFL events don't get an id
+	struct linux_task_stats *ltse = NULL;
+	if (e->type != SFL) {
+		e->task_id = task_table_intern(ls->tasks, &e->key);
+		if (e->task_id >= ls->num_task_stats) {
+			ls->task_stats = (struct linux_task_stats *)realloc(ls->task_stats, ls->tasks->size * sizeof(struct linux_task_stats));
+			memset(ls->task_stats + ls->num_task_stats, 0, (ls->tasks->size - ls->num_task_stats) * sizeof(struct linux_task_stats));
+			ls->num_task_stats = ls->tasks->size;
+		}
+		ltse = &ls->task_stats[e->task_id];
+	}
+	switch (e->type) {
+		case FMA:
+			// folio mark accessed ()
+			ls->fma += e->count;
+			ltse->fma += e->count;
+			break;
+		case FAF:
+			// filemap add folio (miss)
+			ls->faf += e->count;
+			ltse->faf += e->count;
+			break;
+		case FMD:
+			ls->fmd += e->count;
+			ltse->fmd += e->count;
+			break;
+		case MBD:
+			ls->mbd += e->count;
+			ltse->mbd += e->count;
+			break;
+		default:
+			break;
+	}
+}
+
+void linux_stats_save(struct linux_stats *ls, struct checkpoint *c) {
+	checkpoint_write(c, &ls->fma, sizeof(ls->fma));
+	checkpoint_write(c, &ls->faf, sizeof(ls->faf));
+	checkpoint_write(c, &ls->fmd, sizeof(ls->fmd));
+	checkpoint_write(c, &ls->mbd, sizeof(ls->mbd));
+	task_table_save(ls->tasks, c);
+	checkpoint_write_array(c, ls->task_stats, sizeof(struct linux_task_stats), ls->tasks->num_tasks);
+}
+
+// Restores saved stats into ls, which must not have seen any events
+void linux_stats_load(struct linux_stats *ls, struct checkpoint *c) {
+	checkpoint_read(c, &ls->fma, sizeof(ls->fma));
+	checkpoint_read(c, &ls->faf, sizeof(ls->faf));
+	checkpoint_read(c, &ls->fmd, sizeof(ls->fmd));
+	checkpoint_read(c, &ls->mbd, sizeof(ls->mbd));
+	task_table_load(ls->tasks, c);
+	uint64_t num_tasks;
+	struct linux_task_stats *task_stats = (struct linux_task_stats *)checkpoint_read_array(c, sizeof(struct linux_task_stats), &num_tasks);
+	if (num_tasks != ls->tasks->num_tasks) {
+		c->failed = 1;
+		num_tasks = 0;
+	}
+	// Sized like linux_stats_track sizes it, to the task table
+	free(ls->task_stats);
+	ls->num_task_stats = ls->tasks->size;
+	ls->task_stats = (struct linux_task_stats *)calloc(ls->num_task_stats, sizeof(struct linux_task_stats));
+	memcpy(ls->task_stats, task_stats, num_tasks * sizeof(struct linux_task_stats));
+	free(task_stats);
+}
+
+
+// Hit % of ps, corrected for sampling bias if the events were sampled
+float report_total_hit_percent(struct policy_simulation *ps, struct sampler *sampler) {
+	if (!sampler) {
+		return policy_simulation_total_hit_percent(ps);
+	}
+	return sampler_hit_percent(ps->hits, ps->hits + ps->misses, sampler->expected_accesses);
+}
+
+// Per-task version of report_total_hit_percent. The task is expected to
+// have been sampled at the average rate over all accesses.
+float report_task_hit_percent(struct policy_simulation *ps, struct sampler *sampler, unsigned int task_id, unsigned long task_accesses, unsigned long total_accesses) {
+	if (!sampler) {
+		return policy_simulation_task_hit_percent(ps, task_id);
+	}
+	struct task_stats ts = policy_simulation_task_stats(ps, task_id);
+	return sampler_hit_percent(ts.hits, ts.hits + ts.misses, task_accesses * sampler->expected_accesses / total_accesses);
+}
+
+// Prints hit % by task for the first num_policies simulations, one per policy
+void report_print_task_table(struct policy_simulation **sims, int num_policies, struct sampler *sampler, struct linux_stats *ls) {
+	float real_hit_percent = calculate_linux_hit_percent(ls->fma, ls->faf, ls->fmd, ls->mbd);
+	char header[32];
+	printf("\n");
+	printf("%-16s    ", "Command");
+	printf("%-16s    ", "Real Hit %");
+	for (int i = 0; i < num_policies; i++) {
+		snprintf(header, sizeof(header), "%s Hit %%", sims[i]->policy->name);
+		printf("%-16s    ", header);
+	}
+	printf("%-16s\n", "Hits + Misses");
+
+	printf("%-16s    ", "TOTAL");
+	printf("%-16.2f    ", real_hit_percent);
+	for (int i = 0; i < num_policies; i++) {
+		printf("%-16.2f    ", report_total_hit_percent(sims[i], sampler));
+	}
+	// Every event but SFL is an access, sampled or not
+	unsigned long total_accesses = ls->fma + ls->faf + ls->fmd + ls->mbd;
+	printf("%-16lu\n", total_accesses);
+
+	for (unsigned int id = 0; id < ls->tasks->num_tasks; id++) {
+		struct linux_task_stats *ltse = &ls->task_stats[id];
+		real_hit_percent = calculate_linux_hit_percent(ltse->fma, ltse->faf, ltse->fmd, ltse->mbd);
+
+		if (!isnan(real_hit_percent)) {
+			unsigned long task_accesses = ltse->fma + ltse->faf + ltse->fmd + ltse->mbd;
+			printf("%-16s    ", task_table_key(ls->tasks, id)->command);
+			printf("%-16.2f    ", real_hit_percent);
+			for (int i = 0; i < num_policies; i++) {
+				printf("%-16.2f    ", report_task_hit_percent(sims[i], sampler, id, task_accesses, total_accesses));
+			}
+			printf("%-16lu\n", task_accesses);
+		}
+	}
+}
+
+// Prints total hit % by policy and capacity. sims holds num_policies
+// simulations for each capacity in turn.
+void report_print_capacity_table(struct policy_simulation **sims, int num_policies, const unsigned long *capacities, int num_capacities, struct sampler *sampler, struct linux_stats *ls) {
+	char header[32];
+	printf("\n");
+	printf("%-16s    %-16.2f\n", "Real Hit %", calculate_linux_hit_percent(ls->fma, ls->faf, ls->fmd, ls->mbd));
+	printf("%-16s    ", "Capacity");
+	printf("%-16s    ", "Folios");
+	for (int i = 0; i < num_policies; i++) {
+		snprintf(header, sizeof(header), "%s Hit %%", sims[i]->policy->name);
+		printf("%-16s    ", header);
+	}
+	printf("\n");
+
+	for (int c = 0; c < num_capacities; c++) {
+		char size[32];
+		format_size(capacities[c] * FOLIO_SIZE, size, sizeof(size));
+		printf("%-16s    ", size);
+		printf("%-16lu    ", capacities[c]);
+		for (int i = 0; i < num_policies; i++) {
+			printf("%-16.2f    ", report_total_hit_percent(sims[c * num_policies + i], sampler));
+		}
+		printf("\n");
+	}
+}
+
+
+// Parses a byte count with an optional K, M, G or T suffix. Returns 0 on failure.
+unsigned long parse_size(const char *str) {
+	char *end;
+	unsigned long size = strtoul(str, &end, 10);
+	switch (*end) {
+		case 'T':
+			size <<= 10;
+			// fall through
+		case 'G':
+			size <<= 10;
+			// fall through
+		case 'M':
+			size <<= 10;
+			// fall through
+		case 'K':
+			size <<= 10;
+			end++;
+			break;
+	}
+	if (end == str || (*end && *end != ':')) {
+		return 0;
+	}
+	return size;
+}
+
+// Parses a comma separated list of sizes into folio capacities. An entry of
+// the form start:end expands to every doubling from start up to end.
+int parse_capacities(char *arg, unsigned long *capacities, int *num_capacities) {
+	for (char *item = strtok(arg, ","); item; item = strtok(NULL, ",")) {
+		char *range_end = strchr(item, ':');
+		unsigned long start = parse_size(item);
+		unsigned long end = range_end ? parse_size(range_end + 1) : start;
+		if (start < FOLIO_SIZE || end < start) {
+			return -1;
+		}
+		for (unsigned long size = start; size <= end; size *= 2) {
+			if (*num_capacities == MAX_CAPACITIES) {
+				return -1;
+			}
+			capacities[(*num_capacities)++] = size / FOLIO_SIZE;
+		}
+	}
+	return 0;
+}
+
+void format_size(unsigned long bytes, char *buf, size_t len) {
+	const char *suffixes = "KMGT";
+	int i = -1;
+	while (i < 3 && bytes >= 1024 && bytes % 1024 == 0) {
+		bytes /= 1024;
+		i++;
+	}
+	if (i < 0) {
+		snprintf(buf, len, "%lu", bytes);
+	} else {
+		snprintf(buf, len, "%lu%c", bytes, suffixes[i]);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stddef.h>
+#include "common.h"
+#include "policy_simulation.h"
+#include "sampler.h"
+#include "task_table.h"
+
+// The trace has no folio sizes, so capacities given in bytes assume base pages
+#define FOLIO_SIZE 4096
+#define MAX_CAPACITIES 64
+
+
+// Indexed by event task_id
+struct linux_task_stats {
+	unsigned long fma;
+	unsigned long faf;
+	unsigned long fmd;
+	unsigned long mbd;
+};
+
+/*
+ * What the kernel itself did, counted from the trace next to the
+ * simulations: the per-task tables the hit % reports are built from. Also
+ * interns each event's task, so it has to see every event before the
+ * simulations do.
+ */
+struct linux_stats {
+	struct task_table *tasks;
+	struct linux_task_stats *task_stats;
+	unsigned long num_task_stats;
+	unsigned long fma;
+	unsigned long faf;
+	unsigned long fmd;
+	unsigned long mbd;
+};
+
+
+float calculate_linux_hit_percent(unsigned long fma, unsigned long faf, unsigned long fmd, unsigned long mbd);
+struct linux_stats *linux_stats_init(void);
+void linux_stats_track(struct linux_stats *ls, struct event *e);
+void linux_stats_save(struct linux_stats *ls, struct checkpoint *c);
+void linux_stats_load(struct linux_stats *ls, struct checkpoint *c);
+
+float report_total_hit_percent(struct policy_simulation *ps, struct sampler *sampler);
+float report_task_hit_percent(struct policy_simulation *ps, struct sampler *sampler, unsigned int task_id, unsigned long task_accesses, unsigned long total_accesses);
+void report_print_task_table(struct policy_simulation **sims, int num_policies, struct sampler *sampler, struct linux_stats *ls);
+void report_print_capacity_table(struct policy_simulation **sims, int num_policies, const unsigned long *capacities, int num_capacities, struct sampler *sampler, struct linux_stats *ls);
+
+unsigned long parse_size(const char *str);
+int parse_capacities(char *arg, unsigned long *capacities, int *num_capacities);
+void format_size(unsigned long bytes, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,204 @@
+#include "sampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+struct sampler *sampler_init(double rate, unsigned long max_tracked) {
+	struct sampler *s = (struct sampler *)malloc(sizeof(struct sampler));
+
+	s->threshold = rate * SAMPLER_MODULUS;
+	if (s->threshold == 0) {
+		s->threshold = 1;
+	}
+	s->max_tracked = max_tracked;
+	// uthash requires its hash tables to be initialized with NULL
+	s->tracked = NULL;
+	s->heap = NULL;
+	s->heap_size = 0;
+	s->dropped = NULL;
+	s->num_dropped = 0;
+	s->dropped_size = 0;
+	s->rate_change = 1;
+	s->evict_carry = 0;
+	s->expected_accesses = 0;
+	if (max_tracked) {
+		s->heap = (struct sampled_folio **)malloc((max_tracked + 1) * sizeof(struct sampled_folio *));
+	}
+
+	return s;
+}
+
+double sampler_rate(struct sampler *s) {
+	return (double)s->threshold / SAMPLER_MODULUS;
+}
+
+// splitmix64 finalizer, folio addresses are too regular to use directly
+unsigned long sampler_hash(unsigned long folio) {
+	folio ^= folio >> 30;
+	folio *= 0xbf58476d1ce4e5b9UL;
+	folio ^= folio >> 27;
+	folio *= 0x94d049bb133111ebUL;
+	folio ^= folio >> 31;
+	return folio % SAMPLER_MODULUS;
+}
+
+// Scales an eviction count from the full cache down to the sampled one,
+// carrying the fractional part over to the next call
+unsigned long sampler_scale_evictions(struct sampler *s, unsigned long num_evicted) {
+	double scaled = num_evicted * sampler_rate(s) + s->evict_carry;
+	unsigned long whole = scaled;
+	s->evict_carry = scaled - whole;
+	return whole;
+}
+
+unsigned long sampler_capacity(unsigned long capacity, double rate) {
+	unsigned long scaled = capacity * rate + 0.5;
+	return scaled ? scaled : 1;
+}
+
+unsigned long sampler_scale_capacity(struct sampler *s, unsigned long capacity) {
+	return sampler_capacity(capacity, sampler_rate(s));
+}
+
+void sampler_heap_push(struct sampler *s, struct sampled_folio *sf) {
+	unsigned long i = s->heap_size++;
+	while (i > 0) {
+		unsigned long parent = (i - 1) / 2;
+		if (s->heap[parent]->hash >= sf->hash) {
+			break;
+		}
+		s->heap[i] = s->heap[parent];
+		i = parent;
+	}
+	s->heap[i] = sf;
+}
+
+struct sampled_folio *sampler_heap_pop(struct sampler *s) {
+	struct sampled_folio *top = s->heap[0];
+	struct sampled_folio *last = s->heap[--s->heap_size];
+	unsigned long i = 0;
+	while (1) {
+		unsigned long child = 2 * i + 1;
+		if (child >= s->heap_size) {
+			break;
+		}
+		if (child + 1 < s->heap_size && s->heap[child + 1]->hash > s->heap[child]->hash) {
+			child++;
+		}
+		if (s->heap[child]->hash <= last->hash) {
+			break;
+		}
+		s->heap[i] = s->heap[child];
+		i = child;
+	}
+	if (s->heap_size) {
+		s->heap[i] = last;
+	}
+	return top;
+}
+
+// Lowers the threshold to the largest tracked hash and drops every folio with it.
+// Counts gathered so far were sampled at the old rate, so they are rescaled to
+// the new one, as SHARDS does for its histogram.
+void sampler_lower_threshold(struct sampler *s) {
+	s->rate_change = (double)s->heap[0]->hash / s->threshold;
+	s->expected_accesses *= s->rate_change;
+	s->threshold = s->heap[0]->hash;
+	while (s->heap_size && s->heap[0]->hash >= s->threshold) {
+		struct sampled_folio *sf = sampler_heap_pop(s);
+		if (s->num_dropped == s->dropped_size) {
+			s->dropped_size = s->dropped_size ? 2 * s->dropped_size : 16;
+			s->dropped = (unsigned long *)realloc(s->dropped, s->dropped_size * sizeof(unsigned long));
+		}
+		s->dropped[s->num_dropped++] = sf->folio;
+		HASH_DELETE(hh, s->tracked, sf);
+		free(sf);
+	}
+}
+
+// Returns 1 if e should be simulated. SFL eviction counts are scaled down to
+// the sampled cache in place. If the threshold had to be lowered, the folios
+// that fell out of the sample are left in s->dropped and must be removed from
+// every simulation, and its counts scaled by s->rate_change, before e is replayed.
+int sampler_filter(struct sampler *s, struct event *e) {
+	s->num_dropped = 0;
+	s->rate_change = 1;
+	if (e->type == SFL) {
+		e->num_evicted = sampler_scale_evictions(s, e->num_evicted);
+		return 1;
+	}
+
+	s->expected_accesses += sampler_rate(s) * e->count;
+	unsigned long hash = sampler_hash(e->folio);
+	if (hash >= s->threshold) {
+		return 0;
+	}
+	if (!s->max_tracked) {
+		return 1;
+	}
+
+	struct sampled_folio *sf = NULL;
+	HASH_FIND(hh, s->tracked, &e->folio, sizeof(unsigned long), sf);
+	if (!sf) {
+		sf = (struct sampled_folio *)malloc(sizeof(struct sampled_folio));
+		sf->folio = e->folio;
+		sf->hash = hash;
+		HASH_ADD(hh, s->tracked, folio, sizeof(unsigned long), sf);
+		sampler_heap_push(s, sf);
+		if (s->heap_size > s->max_tracked) {
+			sampler_lower_threshold(s);
+		}
+	}
+	return hash < s->threshold;
+}
+
+// Saves the threshold, the running totals and, in fixed-size mode, the
+// tracked folios in heap order
+void sampler_save(struct sampler *s, struct checkpoint *c) {
+	checkpoint_write(c, &s->threshold, sizeof(s->threshold));
+	checkpoint_write(c, &s->evict_carry, sizeof(s->evict_carry));
+	checkpoint_write(c, &s->expected_accesses, sizeof(s->expected_accesses));
+	checkpoint_write(c, &s->heap_size, sizeof(s->heap_size));
+	for (unsigned long i = 0; i < s->heap_size; i++) {
+		checkpoint_write(c, &s->heap[i]->folio, sizeof(unsigned long));
+		checkpoint_write(c, &s->heap[i]->hash, sizeof(unsigned long));
+	}
+}
+
+// Restores a saved sampler into s, a new sampler with the same max_tracked
+void sampler_load(struct sampler *s, struct checkpoint *c) {
+	unsigned long heap_size;
+	checkpoint_read(c, &s->threshold, sizeof(s->threshold));
+	checkpoint_read(c, &s->evict_carry, sizeof(s->evict_carry));
+	checkpoint_read(c, &s->expected_accesses, sizeof(s->expected_accesses));
+	checkpoint_read(c, &heap_size, sizeof(heap_size));
+	if (heap_size > s->max_tracked) {
+		c->failed = 1;
+		return;
+	}
+	for (unsigned long i = 0; i < heap_size && !c->failed; i++) {
+		struct sampled_folio *sf = (struct sampled_folio *)malloc(sizeof(struct sampled_folio));
+		checkpoint_read(c, &sf->folio, sizeof(unsigned long));
+		checkpoint_read(c, &sf->hash, sizeof(unsigned long));
+		HASH_ADD(hh, s->tracked, folio, sizeof(unsigned long), sf);
+		s->heap[s->heap_size++] = sf;
+	}
+}
+
+// SHARDS_adj: a sample that happens to include (or miss) a few very hot folios
+// sees more (or fewer) accesses than expected, and those accesses are almost
+// all hits. Moving the difference into the hit count before dividing by the
+// expected number of accesses removes most of that bias.
+float sampler_hit_percent(unsigned long hits, unsigned long accesses, double expected_accesses) {
+	double adjusted_hits = hits + (expected_accesses - accesses);
+	if (expected_accesses <= 0) {
+		return -1;
+	}
+	if (adjusted_hits < 0) {
+		adjusted_hits = 0;
+	}
+	if (adjusted_hits > expected_accesses) {
+		adjusted_hits = expected_accesses;
+	}
+	return 100.0 * adjusted_hits / expected_accesses;
+}
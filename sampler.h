@@ -0,0 +1,58 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <uthash.h>
+#include "common.h"
+#include "checkpoint.h"
+
+// Folio hashes are reduced modulo this before being compared to the threshold
+#define SAMPLER_MODULUS (1UL << 24)
+
+
+struct sampled_folio {
+	unsigned long folio;
+	unsigned long hash;
+	UT_hash_handle hh;
+};
+
+/*
+ * SHARDS-style spatial sampling: a folio is simulated only if its hash falls
+ * below threshold, so every access to a sampled folio is kept and the
+ * simulated cache behaves like a miniature of the full one at rate
+ * threshold / SAMPLER_MODULUS. In fixed-size mode the threshold starts at the
+ * full modulus and is lowered whenever more than max_tracked folios have been
+ * sampled, dropping the folios with the largest hashes.
+ */
+struct sampler {
+	unsigned long threshold;
+	// Most folios kept in the sample, 0 for a fixed rate
+	unsigned long max_tracked;
+	struct sampled_folio *tracked;
+	// Max-heap of the tracked folios by hash
+	struct sampled_folio **heap;
+	unsigned long heap_size;
+	// Folios dropped from the sample by the last sampler_filter call, and the
+	// factor the sampling rate went down by
+	unsigned long *dropped;
+	unsigned long num_dropped;
+	unsigned long dropped_size;
+	double rate_change;
+	// Fraction of a folio left over from scaling eviction counts
+	double evict_carry;
+	// Accesses the sample should have seen at the rates in effect. The
+	// accesses it did see are the simulations' own hits and misses.
+	double expected_accesses;
+};
+
+
+struct sampler *sampler_init(double rate, unsigned long max_tracked);
+double sampler_rate(struct sampler *s);
+unsigned long sampler_scale_evictions(struct sampler *s, unsigned long num_evicted);
+unsigned long sampler_capacity(unsigned long capacity, double rate);
+unsigned long sampler_scale_capacity(struct sampler *s, unsigned long capacity);
+int sampler_filter(struct sampler *s, struct event *e);
+void sampler_save(struct sampler *s, struct checkpoint *c);
+void sampler_load(struct sampler *s, struct checkpoint *c);
+float sampler_hit_percent(unsigned long hits, unsigned long accesses, double expected_accesses);
+
+#endif
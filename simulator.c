@@ -1,44 +1,65 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
 #include <stdbool.h>
-#include <math.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
 #include "common.h"
 #include "policy_simulation.h"
+#include "trace.h"
+#include "trace_decoder.h"
+#include "stack_distance.h"
+#include "sampler.h"
+#include "replay.h"
+#include "task_table.h"
+#include "next_use.h"
+#include "report.h"
+#include "checkpoint.h"
+#include "window.h"
 
 
 struct simulator_opts {
 	bool p;
 	bool s;
+	bool m;
+	bool o;
+	// SHARDS sampling rate, or the most folios to sample. Both 0 when off.
+	double sampling_rate;
+	unsigned long max_sampled;
+	// Worker threads to replay the simulations on, 0 replays them on the reader
+	int num_threads;
+	// Threads to decode the trace on, 0 decodes it on the reader
+	int num_decoders;
+	// Simulated cache sizes in folios. Empty means a single unbounded cache.
+	unsigned long capacities[MAX_CAPACITIES];
+	int num_capacities;
+	// Resume from this checkpoint if it exists, and save the final state to it
+	const char *checkpoint;
+	// Events per window of the windowed hit % CSV, or ns per window if
+	// window_time is set, 0 when off
+	unsigned long window;
+	bool window_time;
+	const char *window_file;
+	// Only replay the events from from_time up to to_time, in ns of Unix
+	// time. Given as --from and --to, and parsed once the trace is open.
+	const char *from;
+	const char *to;
+	unsigned long from_time;
+	unsigned long to_time;
 };
 
-
-struct linux_task_stats_entry {
-	struct task_key key;
-	unsigned long fma;
-	unsigned long faf;
-	unsigned long fmd;
-	unsigned long mbd;
-	UT_hash_handle hh;
+enum {
+	OPT_FROM = 256,
+	OPT_TO,
 };
 
-
-float calculate_linux_hit_percent(unsigned long fma, unsigned long faf, unsigned long fmd, unsigned long mbd) {
-	// total = total cache accesses without counting dirties
-	// misses = total of add to lru because of read misses
-	float total = (float)fma - (float)mbd;
-	float misses = (float)faf - (float)fmd;
-	if (misses < 0)
-		misses = 0;
-	if (total < 0)
-		total = 0;
-	float hits = total - misses;
-	if (hits < 0) {
-		misses = total;
-		hits = 0;
-	}
-	return 100.0 * (hits / total);
-}
+static const struct option long_options[] = {
+	{ "from", required_argument, NULL, OPT_FROM },
+	{ "to", required_argument, NULL, OPT_TO },
+	{ NULL, 0, NULL, 0 },
+};
 
 
 void event_print(struct event *e) {
@@ -61,6 +82,7 @@ void event_print(struct event *e) {
 			break;
 	}
 
+	printf("TIME: %lu.%09lu | CPU: %3u | ", e->time / 1000000000, e->time % 1000000000, e->cpu);
 	switch (e->type) {
 		case SFL:
 			printf("UID: %8d | PID: %8d | COMMAND: %16s | TYPE: %s | NUM_EVICTED: %lu\n", e->key.uid, e->key.pid, e->key.command, type_str, e->num_evicted);
@@ -72,12 +94,129 @@ void event_print(struct event *e) {
 }
 
 
+// Parses a --from or --to time into ns of Unix time: Unix time in seconds, or
+// seconds after the first event of the trace if it starts with +. Returns
+// false if str isn't a time or the time doesn't fit.
+static bool parse_time(const char *str, unsigned long first_time, unsigned long *time) {
+	char *end;
+	bool relative = *str == '+';
+	double seconds = strtod(str + relative, &end);
+	unsigned long offset = relative ? first_time : 0;
+	// The cast below is undefined for values past the range of unsigned long
+	if (end == str + relative || *end || !(seconds >= 0) || seconds * 1e9 >= (double)(ULONG_MAX - offset)) {
+		return false;
+	}
+	*time = offset + (unsigned long)(seconds * 1e9);
+	return true;
+}
+
+// Whether e falls in the --from and --to range, always true without them
+static bool simulator_in_range(struct simulator_opts *flags, const struct event *e) {
+	return e->time >= flags->from_time && e->time < flags->to_time;
+}
+
+// Whether e starts a new window: every flags->window events, or the first
+// event at or past the next multiple of flags->window ns
+static bool simulator_window_ends(struct simulator_opts *flags, struct window_report *wr, const struct event *e) {
+	if (e->seq == wr->start) {
+		return false;
+	}
+	if (flags->window_time) {
+		return e->time >= wr->start_time + flags->window;
+	}
+	return e->seq % flags->window == 0;
+}
+
+
+// Fills in where the replay stopped and the options that shaped the state
+void simulator_checkpoint_header(struct checkpoint_header *header, struct simulator_opts *flags, struct trace_reader *tr, unsigned long chunk, unsigned long chunk_events, unsigned long num_events, int num_sims) {
+	memset(header, 0, sizeof(struct checkpoint_header));
+	memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	header->version = CHECKPOINT_VERSION;
+	header->trace_format = tr->format;
+	header->chunk = chunk;
+	header->trace_offset = trace_reader_chunk_offset(tr, chunk);
+	header->chunk_events = chunk_events;
+	size_t data_start = tr->start - tr->map;
+	size_t fingerprint_start = header->trace_offset > data_start + CHECKPOINT_FINGERPRINT_SIZE ? header->trace_offset - CHECKPOINT_FINGERPRINT_SIZE : data_start;
+	header->fingerprint = checkpoint_fingerprint(tr->map + fingerprint_start, header->trace_offset - fingerprint_start);
+	header->num_events = num_events;
+	header->num_sims = num_sims;
+	header->simulate_evictions = flags->s;
+	header->sampling_rate = flags->sampling_rate;
+	header->max_sampled = flags->max_sampled;
+}
+
+// Returns 0 on success
+int simulator_save_checkpoint(struct checkpoint *c, const char *path, struct checkpoint_header *header, struct policy_simulation **sims, unsigned long *sim_capacities, int num_sims, struct sampler *sampler, struct linux_stats *ls) {
+	checkpoint_write(c, header, sizeof(struct checkpoint_header));
+	linux_stats_save(ls, c);
+	if (sampler) {
+		sampler_save(sampler, c);
+	}
+	for (int i = 0; i < num_sims; i++) {
+		checkpoint_write(c, &sim_capacities[i], sizeof(unsigned long));
+		policy_simulation_save(sims[i], c);
+	}
+	return checkpoint_commit(c, path);
+}
+
+// Restores the state saved by a run with the same options on a prefix of
+// this trace, and sets *header to where it stopped. Returns 0 if the
+// checkpoint doesn't fit.
+int simulator_load_checkpoint(struct checkpoint *c, struct checkpoint_header *header, struct simulator_opts *flags, struct trace_reader *tr, struct policy_simulation **sims, unsigned long *sim_capacities, int num_sims, struct sampler *sampler, struct linux_stats *ls) {
+	struct checkpoint_header expected;
+	checkpoint_read(c, header, sizeof(struct checkpoint_header));
+	if (c->failed || memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) || header->version != CHECKPOINT_VERSION) {
+		checkpoint_close(c);
+		return 0;
+	}
+	// Hashing the same bytes of this trace has to give the same header
+	simulator_checkpoint_header(&expected, flags, tr, header->chunk, header->chunk_events, header->num_events, num_sims);
+	if (memcmp(header, &expected, sizeof(struct checkpoint_header))) {
+		checkpoint_close(c);
+		return 0;
+	}
+
+	linux_stats_load(ls, c);
+	if (sampler) {
+		sampler_load(sampler, c);
+	}
+	for (int i = 0; i < num_sims && !c->failed; i++) {
+		unsigned long capacity;
+		checkpoint_read(c, &capacity, sizeof(capacity));
+		if (capacity != sim_capacities[i]) {
+			c->failed = 1;
+		}
+		policy_simulation_load(sims[i], c);
+	}
+	int loaded = !c->failed;
+	checkpoint_close(c);
+	return loaded;
+}
+
+
 int main(int argc, char **argv) {
 	struct simulator_opts flags;
 	flags.p = false;
 	flags.s = false;
+	flags.m = false;
+	flags.o = false;
+	flags.sampling_rate = 0;
+	flags.max_sampled = 0;
+	flags.num_threads = 0;
+	flags.num_decoders = 0;
+	flags.num_capacities = 0;
+	flags.checkpoint = NULL;
+	flags.window = 0;
+	flags.window_time = false;
+	flags.window_file = "windows.csv";
+	flags.from = NULL;
+	flags.to = NULL;
+	flags.from_time = 0;
+	flags.to_time = ULONG_MAX;
 	int opt;
-	while ((opt = getopt(argc, argv, "ps")) != -1) {
+	while ((opt = getopt_long(argc, argv, "psmoc:r:t:j:d:k:w:W:", long_options, NULL)) != -1) {
 		switch(opt) {
 			case 'p':
 				flags.p = true;
@@ -85,132 +224,344 @@ int main(int argc, char **argv) {
 			case 's':
 				flags.s = true;
 				break;
+			case 'm':
+				flags.m = true;
+				break;
+			case 'o':
+				flags.o = true;
+				break;
+			case 'c':
+				if (parse_capacities(optarg, flags.capacities, &flags.num_capacities)) {
+					printf("Invalid capacity list: %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'r':
+				flags.sampling_rate = strtod(optarg, NULL);
+				if (flags.sampling_rate <= 0 || flags.sampling_rate > 1) {
+					printf("Sampling rate must be in (0, 1]\n");
+					return 1;
+				}
+				break;
+			case 't':
+				flags.max_sampled = strtoul(optarg, NULL, 10);
+				break;
+			case 'j':
+				flags.num_threads = atoi(optarg);
+				break;
+			case 'd':
+				flags.num_decoders = atoi(optarg);
+				break;
+			case 'k':
+				flags.checkpoint = optarg;
+				break;
+			case 'w': {
+				// Events, or seconds with an s suffix
+				char *end;
+				double window = strtod(optarg, &end);
+				flags.window_time = *end == 's' && !end[1];
+				if (flags.window_time) {
+					// Capped so the ns fit in an unsigned long
+					flags.window = window > 0 && window <= 1e9 ? (unsigned long)(window * 1e9) : 0;
+				} else {
+					flags.window = strtoul(optarg, NULL, 10);
+				}
+				if (!flags.window) {
+					printf("Invalid window: %s\n", optarg);
+					return 1;
+				}
+				break;
+			}
+			case 'W':
+				flags.window_file = optarg;
+				break;
+			case OPT_FROM:
+				flags.from = optarg;
+				break;
+			case OPT_TO:
+				flags.to = optarg;
+				break;
 			case '?':
-				printf("Usage: %s [-p] [-s]\n", argv[0]);
+				printf("Usage: %s [-p] [-s] [-m] [-o] [-c capacities] [-r rate | -t max_folios] [-j threads] [-d threads] [-k checkpoint] [-w events | -w seconds's'] [-W file] [--from time] [--to time]\n", argv[0]);
 				printf("-p: Print events\n");
 				printf("-s: Simulate evictions\n");
+				printf("-m: Print the LRU miss ratio curve as CSV\n");
+				printf("-o: Also simulate Belady's OPT, the best hit %% any policy could get\n");
+				printf("-c: Simulate fixed cache sizes, e.g. 64M,1G or 64M:64G for every doubling in between\n");
+				printf("-r: Only simulate a sampled fraction of the folios, e.g. 0.01\n");
+				printf("-t: Only simulate a sample of at most this many folios\n");
+				printf("-j: Replay the simulations on this many worker threads\n");
+				printf("-d: Decode the trace on this many threads\n");
+				printf("-k: Resume from this checkpoint if it exists, and save the state to it after the replay\n");
+				printf("-w: Write hit %% every this many events, or seconds with an s suffix (e.g. 10s), to a CSV file, overall and per task\n");
+				printf("-W: CSV file for -w, windows.csv by default\n");
+				printf("--from, --to: Only replay the events in this time range, in Unix seconds or +seconds after the start of the trace\n");
 				return 1;
 				break;
 		}
 	}
 
 
-	FILE *log_file = fopen("page.log", "r");
+	// OPT's decisions and the stack distances depend on accesses the trace
+	// doesn't have yet, so neither can be carried over to a longer trace
+	if (flags.checkpoint && (flags.o || flags.m)) {
+		printf("-k can't be combined with -o or -m\n");
+		return 1;
+	}
+	// A checkpoint resumes where the last replay stopped, not at a time
+	if (flags.checkpoint && (flags.from || flags.to)) {
+		printf("-k can't be combined with --from or --to\n");
+		return 1;
+	}
+
+	struct trace_reader *log_file = trace_reader_open("page.log");
 	if (!log_file) {
 		printf("Failed to open log file\n");
 		return 0;
 	}
 
-	struct policy_simulation *fifo_ps = policy_simulation_init(&fifo_hit_update, &fifo_miss_update);
-	struct policy_simulation *lfu_ps = policy_simulation_init(&lfu_hit_update, &lfu_miss_update);
-	struct policy_simulation *lru_ps = policy_simulation_init(&lru_hit_update, &lru_miss_update);
-	struct policy_simulation *mru_ps = policy_simulation_init(&mru_hit_update, &mru_miss_update);
-
-	struct linux_task_stats_entry *linux_task_stats = NULL;
-	unsigned long fma, faf, fmd, mbd;
-	fma = faf = fmd = mbd = 0;
-
-	struct event e;
-	unsigned long event_count = 0;
-	while (fscanf(log_file, "%lu,%d,%d,%d,%[^\n]s\n", &e.data, (int *)&e.type, &e.key.uid, &e.key.pid, e.key.command) == 5) {
-		event_count++;
-		if (flags.s && event_count % 100 == 0) {
-			unsigned long num_evicted = 10;
-			policy_simulation_evict(fifo_ps, num_evicted);
-			policy_simulation_evict(lfu_ps, num_evicted);
-			policy_simulation_evict(lru_ps, num_evicted);
-			policy_simulation_evict(mru_ps, num_evicted);
+	if (flags.window_time && !trace_reader_chunk_time(log_file, 0)) {
+		printf("page.log has no event times, -w in seconds needs a binary or compact trace recorded with them\n");
+		return 1;
+	}
+
+	// Only the chunks that can hold events in the range are decoded. The
+	// ones either side are too, in case times around a chunk boundary are
+	// out of order.
+	unsigned long first_chunk = 0;
+	unsigned long end_chunk = trace_reader_num_chunks(log_file);
+	if (flags.from || flags.to) {
+		unsigned long first_time = trace_reader_chunk_time(log_file, 0);
+		if (!first_time) {
+			printf("page.log has no event times, --from and --to need a binary or compact trace recorded with them\n");
+			return 1;
+		}
+		if (flags.from && !parse_time(flags.from, first_time, &flags.from_time)) {
+			printf("Invalid time: %s\n", flags.from);
+			return 1;
 		}
-		if (flags.p) {
-			event_print(&e);
+		if (flags.to && !parse_time(flags.to, first_time, &flags.to_time)) {
+			printf("Invalid time: %s\n", flags.to);
+			return 1;
 		}
+		first_chunk = trace_reader_find_chunk(log_file, flags.from_time);
+		first_chunk = first_chunk ? first_chunk - 1 : 0;
+		if (flags.to) {
+			unsigned long last_chunk = trace_reader_find_chunk(log_file, flags.to_time) + 2;
+			end_chunk = last_chunk < end_chunk ? last_chunk : end_chunk;
+		}
+	}
+
+	const struct policy *sim_policies[16];
+	int num_policies = 0;
+	while (policies[num_policies]) {
+		sim_policies[num_policies] = policies[num_policies];
+		num_policies++;
+	}
+	struct next_use *next_use = NULL;
+	if (flags.o) {
+		sim_policies[num_policies++] = &opt_policy;
 
-		struct linux_task_stats_entry *ltse = NULL;
-		HASH_FIND(hh, linux_task_stats, &e.key, sizeof(struct task_key), ltse);
-		if (!ltse && e.type != SFL) {
-			ltse = (struct linux_task_stats_entry *)malloc(sizeof(struct linux_task_stats_entry));
-			ltse->key = e.key;
-			ltse->fma = 0;
-			ltse->faf = 0;
-			ltse->fmd = 0;
-			ltse->mbd = 0;
-			HASH_ADD(hh, linux_task_stats, key, sizeof(struct task_key), ltse);
+		// OPT needs to know when every folio is used next before the replay starts
+		struct timespec index_start, index_end;
+		clock_gettime(CLOCK_MONOTONIC, &index_start);
+		next_use = next_use_init();
+		struct trace_decoder *decoder = trace_decoder_init(log_file, first_chunk, end_chunk, flags.num_decoders);
+		const struct event *batch;
+		unsigned long batch_size;
+		while ((batch = trace_decoder_next(decoder, &batch_size))) {
+			for (unsigned long b = 0; b < batch_size; b++) {
+				if (simulator_in_range(&flags, &batch[b])) {
+					next_use_track(next_use, &batch[b]);
+				}
+			}
 		}
-		switch (e.type) {
-			case FMA:
-                // folio mark accessed ()
-				fma++;
-				ltse->fma++;
-				break;
-			case FAF:
-                // filemap add folio (miss)
-				faf++;
-				ltse->faf++;
-				break;
-			case FMD:
-				fmd++;
-				ltse->fmd++;
-				break;
-			case MBD:
-				mbd++;
-				ltse->mbd++;
-				break;
-			default:
-				break;
+		trace_decoder_destroy(decoder);
+		next_use_finish(next_use);
+		clock_gettime(CLOCK_MONOTONIC, &index_end);
+		double elapsed = (index_end.tv_sec - index_start.tv_sec) + (index_end.tv_nsec - index_start.tv_nsec) / 1e9;
+		fprintf(stderr, "Indexed next uses of %lu events in %.2fs\n", next_use->num_events, elapsed);
+	}
+	int num_capacities = flags.num_capacities ? flags.num_capacities : 1;
+	int num_sims = num_policies * num_capacities;
+
+	struct sampler *sampler = NULL;
+	if (flags.sampling_rate || flags.max_sampled) {
+		sampler = sampler_init(flags.sampling_rate ? flags.sampling_rate : 1.0, flags.max_sampled);
+	}
+
+	// One simulation per policy and capacity, all fed from the same events
+	struct policy_simulation **sims = (struct policy_simulation **)malloc(num_sims * sizeof(struct policy_simulation *));
+	unsigned long *sim_capacities = (unsigned long *)malloc(num_sims * sizeof(unsigned long));
+	for (int c = 0; c < num_capacities; c++) {
+		for (int i = 0; i < num_policies; i++) {
+			unsigned long capacity = flags.num_capacities ? flags.capacities[c] : 0;
+			sim_capacities[c * num_policies + i] = capacity;
+			if (sampler && capacity) {
+				capacity = sampler_scale_capacity(sampler, capacity);
+			}
+			sims[c * num_policies + i] = policy_simulation_init(sim_policies[i], capacity);
+			if (sim_policies[i] == &opt_policy) {
+				opt_init(sims[c * num_policies + i], next_use);
+			}
+		}
+	}
+	struct linux_stats *ls = linux_stats_init();
+
+	struct checkpoint_header resume;
+	memset(&resume, 0, sizeof(resume));
+	struct checkpoint *ckpt = flags.checkpoint ? checkpoint_open(flags.checkpoint) : NULL;
+	if (ckpt) {
+		if (!simulator_load_checkpoint(ckpt, &resume, &flags, log_file, sims, sim_capacities, num_sims, sampler, ls)) {
+			printf("Checkpoint %s doesn't match page.log or these options\n", flags.checkpoint);
+			return 1;
+		}
+		fprintf(stderr, "Resuming from %s after %lu events\n", flags.checkpoint, (unsigned long)resume.num_events);
+	}
+
+	struct window_report *windows = NULL;
+	if (flags.window) {
+		windows = window_report_init(flags.window_file, sims, num_sims, sim_capacities, ls, sampler, resume.num_events);
+		if (!windows) {
+			printf("Failed to open %s\n", flags.window_file);
+			return 1;
+		}
+		windows->times = trace_reader_chunk_time(log_file, 0) != 0;
+	}
+
+	struct replay *replay = replay_init(sims, num_sims, sim_capacities, flags.num_threads);
+	struct replay_item item;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct stack_distance *sd = flags.m ? stack_distance_init() : NULL;
+
+	if (flags.checkpoint) {
+		first_chunk = resume.chunk;
+	}
+	struct trace_decoder *decoder = trace_decoder_init(log_file, first_chunk, end_chunk, flags.num_decoders);
+	const struct event *batch;
+	unsigned long batch_size;
+	unsigned long event_count = resume.num_events;
+	// The chunk the next checkpoint resumes at, and its events replayed so far
+	unsigned long chunk = resume.chunk;
+	unsigned long chunk_events = resume.chunk_events;
+	while ((batch = trace_decoder_next(decoder, &batch_size))) {
+		// The start of the chunk the checkpoint stopped in was already replayed
+		unsigned long first = decoder->consumed == resume.chunk ? resume.chunk_events : 0;
+		chunk = decoder->consumed;
+		chunk_events = batch_size;
+		for (unsigned long b = first; b < batch_size; b++) {
+			struct event e = batch[b];
+			if (!simulator_in_range(&flags, &e)) {
+				continue;
+			}
+			// The position OPT's next use index is keyed by
+			e.seq = event_count;
+			if (windows && simulator_window_ends(&flags, windows, &e)) {
+				replay_sync(replay);
+				window_report_emit(windows, e.seq);
+			}
+			if (windows && e.seq == windows->start) {
+				windows->start_time = flags.window_time ? e.time / flags.window * flags.window : e.time;
+			}
+			event_count++;
+			if (flags.s && event_count % 100 == 0) {
+				item.op = REPLAY_EVICT;
+				item.num_evicted = sampler ? sampler_scale_evictions(sampler, 10) : 10;
+				replay_push(replay, &item);
+			}
+			if (flags.p) {
+				event_print(&e);
+			}
+
+			linux_stats_track(ls, &e);
+			if (windows && e.type != SFL) {
+				window_report_touch(windows, e.task_id);
+			}
+
+			if (sampler) {
+				int sampled = sampler_filter(sampler, &e);
+				if (sampler->num_dropped) {
+					// The sampling rate went down, shrink every simulation to match
+					for (unsigned long j = 0; j < sampler->num_dropped; j++) {
+						item.op = REPLAY_REMOVE;
+						item.folio = sampler->dropped[j];
+						replay_push(replay, &item);
+					}
+					item.op = REPLAY_RESCALE;
+					item.rate_change = sampler->rate_change;
+					item.rate = sampler_rate(sampler);
+					replay_push(replay, &item);
+					if (windows) {
+						window_report_rescale(windows, sampler->rate_change);
+					}
+				}
+				if (!sampled) {
+					continue;
+				}
+			}
+
+			item.op = REPLAY_ACCESS;
+			item.e = e;
+			replay_push(replay, &item);
+			if (sd) {
+				stack_distance_track_access(sd, &e);
+			}
+		}
+	}
+	trace_decoder_destroy(decoder);
+	replay_finish(replay);
+	if (windows) {
+		if (event_count > windows->start) {
+			window_report_emit(windows, event_count);
 		}
+		window_report_close(windows);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	unsigned long num_replayed = event_count - resume.num_events;
+	size_t num_bytes = trace_reader_chunk_offset(log_file, end_chunk) - trace_reader_chunk_offset(log_file, first_chunk);
+	fprintf(stderr, "Replayed %lu events in %.2fs (%.0f events/sec, %.1f MB/s of trace)\n", num_replayed, elapsed, num_replayed / elapsed, num_bytes / elapsed / 1e6);
 
-		policy_simulation_track_access(fifo_ps, &e);
-		policy_simulation_track_access(lfu_ps, &e);
-		policy_simulation_track_access(lru_ps, &e);
-		policy_simulation_track_access(mru_ps, &e);
-	}
-
-	fclose(log_file);
-
-	struct linux_task_stats_entry *ltse = NULL;
-	struct linux_task_stats_entry *tmp = NULL;
-	printf("\n");
-	printf("%-16s    ", "Command");
-	printf("%-16s    ", "Real Hit %");
-	printf("%-16s    ", "FIFO Hit %");
-	printf("%-16s    ", "LFU Hit %");
-	printf("%-16s    ", "LRU Hit %");
-	printf("%-16s    ", "MRU Hit %");
-	printf("%-16s\n", "Hits + Misses");
-
-	float real_hit_percent, fifo_hit_percent, lfu_hit_percent, lru_hit_percent, mru_hit_percent;
-	real_hit_percent = calculate_linux_hit_percent(fma, faf, fmd, mbd);
-	fifo_hit_percent = policy_simulation_total_hit_percent(fifo_ps);
-	lfu_hit_percent = policy_simulation_total_hit_percent(lfu_ps);
-	lru_hit_percent = policy_simulation_total_hit_percent(lru_ps);
-	mru_hit_percent = policy_simulation_total_hit_percent(mru_ps);
-	printf("%-16s    ", "TOTAL");
-	printf("%-16.2f    ", real_hit_percent);
-	printf("%-16.2f    ", fifo_hit_percent);
-	printf("%-16.2f    ", lfu_hit_percent);
-	printf("%-16.2f    ", lru_hit_percent);
-	printf("%-16.2f    ", mru_hit_percent);
-	printf("%-16lu\n", fifo_ps->hits + fifo_ps->misses);
-
-	HASH_ITER(hh, linux_task_stats, ltse, tmp) {
-		real_hit_percent = calculate_linux_hit_percent(ltse->fma, ltse->faf, ltse->fmd, ltse->mbd);
-
-		fifo_hit_percent = policy_simulation_task_hit_percent(fifo_ps, &ltse->key);
-		lfu_hit_percent = policy_simulation_task_hit_percent(lfu_ps, &ltse->key);
-		lru_hit_percent = policy_simulation_task_hit_percent(lru_ps, &ltse->key);
-		mru_hit_percent = policy_simulation_task_hit_percent(mru_ps, &ltse->key);
-
-
-		if (!isnan(real_hit_percent)) {
-			struct task_stats_entry *tse = NULL;
-			HASH_FIND(hh, fifo_ps->task_stats, &ltse->key, sizeof(struct task_key), tse);
-			printf("%-16s    ", ltse->key.command);
-			printf("%-16.2f    ", real_hit_percent);
-			printf("%-16.2f    ", fifo_hit_percent);
-			printf("%-16.2f    ", lfu_hit_percent);
-			printf("%-16.2f    ", lru_hit_percent);
-			printf("%-16.2f    ", mru_hit_percent);
-			printf("%-16lu\n", tse->hits + tse->misses);
+	if (flags.checkpoint) {
+		struct checkpoint_header header;
+		simulator_checkpoint_header(&header, &flags, log_file, chunk, chunk_events, event_count, num_sims);
+		ckpt = checkpoint_create(flags.checkpoint);
+		if (!ckpt || simulator_save_checkpoint(ckpt, flags.checkpoint, &header, sims, sim_capacities, num_sims, sampler, ls)) {
+			printf("Failed to write checkpoint %s\n", flags.checkpoint);
+			return 1;
 		}
 	}
+
+	char filter[256];
+	snprintf(filter, sizeof(filter), "%s", log_file->filter);
+	uint64_t dropped = trace_reader_dropped(log_file);
+	if (dropped) {
+		fprintf(stderr, "Warning: the profiler dropped %lu events while recording page.log\n", (unsigned long)dropped);
+	}
+	trace_reader_close(log_file);
+
+	double sampling_rate = sampler ? sampler_rate(sampler) : 1.0;
+
+	if (*filter) {
+		printf("\n");
+		printf("%-16s    %s\n", "Profiler Filter", filter);
+	}
+
+	if (sampler) {
+		printf("\n");
+		printf("%-16s    %-16f\n", "Sampling Rate", sampling_rate);
+	}
+
+	if (flags.num_capacities) {
+		report_print_capacity_table(sims, num_policies, flags.capacities, num_capacities, sampler, ls);
+	} else {
+		report_print_task_table(sims, num_policies, sampler, ls);
+	}
+
+	if (sd) {
+		stack_distance_print_csv(sd, ls->tasks, sampling_rate);
+	}
 }
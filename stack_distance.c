@@ -0,0 +1,181 @@
+#include "stack_distance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STACK_DISTANCE_MIN_TREE_SIZE (1 << 16)
+
+
+struct stack_distance *stack_distance_init(void) {
+	struct stack_distance *sd = (struct stack_distance *)malloc(sizeof(struct stack_distance));
+
+	// uthash requires its hash tables to be initialized with NULL
+	sd->last_access = NULL;
+	sd->task_stats = NULL;
+	sd->num_task_stats = 0;
+	sd->tree_size = STACK_DISTANCE_MIN_TREE_SIZE;
+	sd->tree = (unsigned int *)calloc(sd->tree_size + 1, sizeof(unsigned int));
+	sd->now = 0;
+	sd->histogram_size = 1024;
+	sd->histogram = (unsigned long *)calloc(sd->histogram_size, sizeof(unsigned long));
+	sd->accesses = 0;
+	sd->cold_misses = 0;
+
+	return sd;
+}
+
+// Fenwick tree over times 1..tree_size
+void stack_distance_tree_add(struct stack_distance *sd, unsigned long time, int delta) {
+	for (; time <= sd->tree_size; time += time & -time) {
+		sd->tree[time] += delta;
+	}
+}
+
+unsigned long stack_distance_tree_sum(struct stack_distance *sd, unsigned long time) {
+	unsigned long sum = 0;
+	for (; time > 0; time -= time & -time) {
+		sum += sd->tree[time];
+	}
+	return sum;
+}
+
+int folio_time_cmp(const void *left, const void *right) {
+	unsigned long l = (*(struct folio_time_entry **)left)->time;
+	unsigned long r = (*(struct folio_time_entry **)right)->time;
+	return (l > r) - (l < r);
+}
+
+// Once every time slot has been used, renumbers the live folios 1..n in the
+// order of their last access and rebuilds the tree. Relative order is all the
+// distances depend on, so this keeps memory proportional to the number of
+// distinct folios instead of the length of the trace.
+void stack_distance_compact(struct stack_distance *sd) {
+	unsigned long num_live = HASH_COUNT(sd->last_access);
+	struct folio_time_entry **live = (struct folio_time_entry **)malloc(num_live * sizeof(struct folio_time_entry *));
+	struct folio_time_entry *fte = NULL;
+	struct folio_time_entry *tmp = NULL;
+	unsigned long i = 0;
+	HASH_ITER(hh, sd->last_access, fte, tmp) {
+		live[i++] = fte;
+	}
+	qsort(live, num_live, sizeof(struct folio_time_entry *), folio_time_cmp);
+
+	if (2 * num_live > sd->tree_size) {
+		sd->tree_size = 2 * num_live;
+		free(sd->tree);
+		sd->tree = (unsigned int *)malloc((sd->tree_size + 1) * sizeof(unsigned int));
+	}
+	memset(sd->tree, 0, (sd->tree_size + 1) * sizeof(unsigned int));
+
+	for (i = 1; i <= sd->tree_size; i++) {
+		if (i <= num_live) {
+			live[i - 1]->time = i;
+			sd->tree[i] += 1;
+		}
+		unsigned long parent = i + (i & -i);
+		if (parent <= sd->tree_size) {
+			sd->tree[parent] += sd->tree[i];
+		}
+	}
+	sd->now = num_live;
+	free(live);
+}
+
+int stack_distance_bucket(unsigned long distance) {
+	return distance ? 64 - __builtin_clzl(distance) : 0;
+}
+
+void stack_distance_track_access(struct stack_distance *sd, const struct event *e) {
+	if (e->type != FMA && e->type != FAF) {
+		return;
+	}
+
+	if (e->task_id >= sd->num_task_stats) {
+		unsigned int num_task_stats = sd->num_task_stats ? sd->num_task_stats : 64;
+		while (e->task_id >= num_task_stats) {
+			num_task_stats *= 2;
+		}
+		sd->task_stats = (struct stack_distance_task_stats *)realloc(sd->task_stats, num_task_stats * sizeof(struct stack_distance_task_stats));
+		memset(sd->task_stats + sd->num_task_stats, 0, (num_task_stats - sd->num_task_stats) * sizeof(struct stack_distance_task_stats));
+		sd->num_task_stats = num_task_stats;
+	}
+	struct stack_distance_task_stats *sdte = &sd->task_stats[e->task_id];
+
+	if (sd->now == sd->tree_size) {
+		stack_distance_compact(sd);
+	}
+	unsigned long now = ++sd->now;
+	sd->accesses += e->count;
+	sdte->accesses += e->count;
+	// The repeats of a weighted access all come right after it, at distance 0
+	unsigned long repeats = e->count > 1 ? e->count - 1 : 0;
+	sd->histogram[0] += repeats;
+	sdte->buckets[0] += repeats;
+
+	struct folio_time_entry *fte = NULL;
+	HASH_FIND(hh, sd->last_access, &e->folio, sizeof(unsigned long), fte);
+	if (!fte) {
+		sd->cold_misses++;
+		sdte->cold_misses++;
+		fte = (struct folio_time_entry *)malloc(sizeof(struct folio_time_entry));
+		fte->folio = e->folio;
+		HASH_ADD(hh, sd->last_access, folio, sizeof(unsigned long), fte);
+	} else {
+		unsigned long distance = stack_distance_tree_sum(sd, now - 1) - stack_distance_tree_sum(sd, fte->time);
+		if (distance >= sd->histogram_size) {
+			unsigned long new_size = sd->histogram_size;
+			while (distance >= new_size) {
+				new_size *= 2;
+			}
+			sd->histogram = (unsigned long *)realloc(sd->histogram, new_size * sizeof(unsigned long));
+			memset(sd->histogram + sd->histogram_size, 0, (new_size - sd->histogram_size) * sizeof(unsigned long));
+			sd->histogram_size = new_size;
+		}
+		sd->histogram[distance]++;
+		sdte->buckets[stack_distance_bucket(distance)]++;
+		stack_distance_tree_add(sd, fte->time, -1);
+	}
+	fte->time = now;
+	stack_distance_tree_add(sd, now, 1);
+}
+
+// Prints the LRU miss ratio at every power of two capacity (in folios), up to
+// the first capacity where only cold misses are left. The overall curve comes
+// first, followed by one curve per task. If the events were sampled,
+// capacities are scaled back up by sampling_rate.
+void stack_distance_print_csv(struct stack_distance *sd, struct task_table *tasks, double sampling_rate) {
+	unsigned long max_distance = 0;
+	for (unsigned long d = 0; d < sd->histogram_size; d++) {
+		if (sd->histogram[d]) {
+			max_distance = d;
+		}
+	}
+	int max_bucket = stack_distance_bucket(max_distance) + 1;
+
+	printf("\n");
+	printf("command,pid,uid,capacity,miss_ratio\n");
+
+	unsigned long hits = 0;
+	unsigned long d = 0;
+	for (int b = 0; b < max_bucket; b++) {
+		unsigned long capacity = 1UL << b;
+		for (; d < capacity && d < sd->histogram_size; d++) {
+			hits += sd->histogram[d];
+		}
+		printf("\"TOTAL\",,,%lu,%.6f\n", (unsigned long)(capacity / sampling_rate), sd->accesses ? 1.0 - (double)hits / sd->accesses : 0.0);
+	}
+
+	for (unsigned int id = 0; id < sd->num_task_stats; id++) {
+		struct stack_distance_task_stats *sdte = &sd->task_stats[id];
+		if (!sdte->accesses) {
+			continue;
+		}
+		const struct task_key *key = task_table_key(tasks, id);
+		hits = 0;
+		for (int b = 0; b < max_bucket; b++) {
+			// Distances in bucket b are all below 2^b
+			hits += sdte->buckets[b];
+			printf("\"%s\",%u,%u,%lu,%.6f\n", key->command, key->pid, key->uid, (unsigned long)((1UL << b) / sampling_rate), 1.0 - (double)hits / sdte->accesses);
+		}
+	}
+}
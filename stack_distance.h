@@ -0,0 +1,52 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <uthash.h>
+#include "common.h"
+#include "task_table.h"
+
+// Bucket b counts distances in [2^(b-1), 2^b), bucket 0 counts distance 0
+#define STACK_DISTANCE_BUCKETS 65
+
+
+struct folio_time_entry {
+	unsigned long folio;
+	// Time of the folio's most recent access
+	unsigned long time;
+	UT_hash_handle hh;
+};
+
+struct stack_distance_task_stats {
+	unsigned long accesses;
+	unsigned long cold_misses;
+	unsigned long buckets[STACK_DISTANCE_BUCKETS];
+};
+
+/*
+ * Mattson's stack algorithm: the LRU stack distance of an access is the number
+ * of distinct folios touched since the previous access to the same folio, and
+ * the access hits in an LRU cache of size C exactly when its distance is less
+ * than C. Distances are counted with a Fenwick tree over access times that
+ * marks every time which is still some folio's most recent access.
+ */
+struct stack_distance {
+	struct folio_time_entry *last_access;
+	// Per-task histograms indexed by event task_id
+	struct stack_distance_task_stats *task_stats;
+	unsigned int num_task_stats;
+	unsigned int *tree;
+	unsigned long tree_size;
+	unsigned long now;
+	// histogram[d] is the number of accesses with distance d
+	unsigned long *histogram;
+	unsigned long histogram_size;
+	unsigned long accesses;
+	unsigned long cold_misses;
+};
+
+
+struct stack_distance *stack_distance_init(void);
+void stack_distance_track_access(struct stack_distance *sd, const struct event *e);
+void stack_distance_print_csv(struct stack_distance *sd, struct task_table *tasks, double sampling_rate);
+
+#endif
@@ -0,0 +1,66 @@
+#include "task_table.h"
+#include <stdlib.h>
+
+
+struct task_table *task_table_init(void) {
+	struct task_table *tt = (struct task_table *)malloc(sizeof(struct task_table));
+
+	// uthash requires its hash tables to be initialized with NULL
+	tt->index = NULL;
+	tt->size = 64;
+	tt->keys = (struct task_key *)malloc(tt->size * sizeof(struct task_key));
+	tt->num_tasks = 0;
+
+	return tt;
+}
+
+// Returns the id of key, assigning the next free one if it hasn't been seen
+unsigned int task_table_intern(struct task_table *tt, const struct task_key *key) {
+	struct task_table_entry *tte = NULL;
+	HASH_FIND(hh, tt->index, key, sizeof(struct task_key), tte);
+	if (tte) {
+		return tte->id;
+	}
+
+	if (tt->num_tasks == tt->size) {
+		tt->size *= 2;
+		tt->keys = (struct task_key *)realloc(tt->keys, tt->size * sizeof(struct task_key));
+	}
+	tte = (struct task_table_entry *)malloc(sizeof(struct task_table_entry));
+	tte->key = *key;
+	tte->id = tt->num_tasks++;
+	tt->keys[tte->id] = *key;
+	HASH_ADD(hh, tt->index, key, sizeof(struct task_key), tte);
+	return tte->id;
+}
+
+const struct task_key *task_table_key(struct task_table *tt, unsigned int id) {
+	return &tt->keys[id];
+}
+
+void task_table_save(struct task_table *tt, struct checkpoint *c) {
+	checkpoint_write_array(c, tt->keys, sizeof(struct task_key), tt->num_tasks);
+}
+
+// Interns the saved keys into tt, which must be empty, so they get their saved ids back
+void task_table_load(struct task_table *tt, struct checkpoint *c) {
+	uint64_t num_tasks;
+	struct task_key *keys = (struct task_key *)checkpoint_read_array(c, sizeof(struct task_key), &num_tasks);
+	for (uint64_t i = 0; i < num_tasks; i++) {
+		if (task_table_intern(tt, &keys[i]) != i) {
+			c->failed = 1;
+			break;
+		}
+	}
+	free(keys);
+}
+
+void task_table_destroy(struct task_table *tt) {
+	struct task_table_entry *tte, *tmp;
+	HASH_ITER(hh, tt->index, tte, tmp) {
+		HASH_DEL(tt->index, tte);
+		free(tte);
+	}
+	free(tt->keys);
+	free(tt);
+}
@@ -0,0 +1,37 @@
+#ifndef TASK_TABLE_H
+#define TASK_TABLE_H
+
+#include <uthash.h>
+#include "common.h"
+#include "checkpoint.h"
+
+
+struct task_table_entry {
+	struct task_key key;
+	unsigned int id;
+	UT_hash_handle hh;
+};
+
+/*
+ * Interns task keys into dense ids as events are decoded, so per-task
+ * counters can live in flat arrays indexed by event task_id. Ids are handed
+ * out in order of first appearance, and keys are only looked up again when a
+ * report is printed.
+ */
+struct task_table {
+	struct task_table_entry *index;
+	// keys[id] is the key interned as id
+	struct task_key *keys;
+	unsigned int num_tasks;
+	unsigned int size;
+};
+
+
+struct task_table *task_table_init(void);
+unsigned int task_table_intern(struct task_table *tt, const struct task_key *key);
+const struct task_key *task_table_key(struct task_table *tt, unsigned int id);
+void task_table_save(struct task_table *tt, struct checkpoint *c);
+void task_table_load(struct task_table *tt, struct checkpoint *c);
+void task_table_destroy(struct task_table *tt);
+
+#endif
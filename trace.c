@@ -0,0 +1,725 @@
+#include "trace.h"
+#include "task_table.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*
+ * Compact encoding. A block is a trace_block_header, its task definitions
+ * and then its records, all varints (7 bits per byte, low bits first, high
+ * bit set on every byte but the last).
+ *   task: uid, pid, command length as one byte, command bytes
+ *   record: a tag byte with the type in TAG_TYPE, TAG_TASK if the task
+ *   differs from the previous record's, TAG_COUNT if count is not 1, TAG_CPU
+ *   if the CPU differs from the previous record's
+ *     the task id, if TAG_TASK
+ *     SFL: num_evicted. Otherwise the zigzag encoded difference between the
+ *     shifted folio and the previous record's shifted folio.
+ *     count, if TAG_COUNT
+ *     the CPU, if TAG_CPU
+ *     the zigzag encoded difference between the time and the previous
+ *     record's, if the block is TRACE_BLOCK_TIMED
+ * The previous folio, time and CPU start at 0 and the previous task at none
+ * in every block, so only the task definitions carry over between blocks.
+ * Times from different CPUs can be slightly out of order, hence the zigzag.
+ */
+#define TAG_TYPE 0x07
+#define TAG_TASK 0x08
+#define TAG_COUNT 0x10
+#define TAG_CPU 0x20
+
+// Worst case encodings, for sizing the block buffer
+#define RECORD_MAX_ENCODED (1 + 5 + 10 + 5 + 5 + 10)
+#define TASK_MAX_ENCODED (5 + 5 + 1 + 16)
+
+
+static unsigned char *put_varint(unsigned char *p, uint64_t v) {
+	while (v >= 0x80) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+// Returns NULL if the varint runs past end or is too long
+static const unsigned char *get_varint(const unsigned char *p, const unsigned char *end, uint64_t *v) {
+	uint64_t result = 0;
+	for (int shift = 0; shift < 64 && p < end; shift += 7) {
+		unsigned char byte = *p++;
+		result |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*v = result;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static uint64_t zigzag(int64_t v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Encodes and writes out the events buffered in tw->block
+static void trace_writer_flush_block(struct trace_writer *tw) {
+	if (!tw->block_records) {
+		return;
+	}
+
+	// Folios are aligned kernel pointers, so their low bits are usually all 0
+	uint64_t folio_bits = 0;
+	bool timed = false;
+	for (unsigned int i = 0; i < tw->block_records; i++) {
+		tw->block[i].task_id = task_table_intern(tw->tasks, &tw->block[i].key);
+		if (tw->block[i].type != SFL) {
+			folio_bits |= tw->block[i].folio;
+		}
+		timed |= tw->block[i].time || tw->block[i].cpu;
+	}
+	struct trace_block_header header;
+	memset(&header, 0, sizeof(header));
+	header.num_records = tw->block_records;
+	header.num_tasks = tw->tasks->num_tasks - tw->num_tasks_written;
+	header.folio_shift = folio_bits ? __builtin_ctzl(folio_bits) : 0;
+	header.flags = timed ? TRACE_BLOCK_TIMED : 0;
+
+	unsigned char *p = tw->encoded;
+	for (unsigned int id = tw->num_tasks_written; id < tw->tasks->num_tasks; id++) {
+		const struct task_key *key = task_table_key(tw->tasks, id);
+		unsigned char len = strnlen(key->command, sizeof(key->command) - 1);
+		p = put_varint(p, key->uid);
+		p = put_varint(p, key->pid);
+		*p++ = len;
+		memcpy(p, key->command, len);
+		p += len;
+	}
+	header.tasks_size = p - tw->encoded;
+
+	unsigned int task = UINT32_MAX;
+	uint64_t folio = 0;
+	uint64_t time = 0;
+	unsigned int cpu = 0;
+	for (unsigned int i = 0; i < tw->block_records; i++) {
+		const struct event *e = &tw->block[i];
+		unsigned int count = e->count ? e->count : 1;
+		unsigned char *tag = p++;
+		*tag = e->type & TAG_TYPE;
+		if (e->task_id != task) {
+			*tag |= TAG_TASK;
+			task = e->task_id;
+			p = put_varint(p, task);
+		}
+		if (e->type == SFL) {
+			p = put_varint(p, e->num_evicted);
+		} else {
+			uint64_t shifted = e->folio >> header.folio_shift;
+			p = put_varint(p, zigzag(shifted - folio));
+			folio = shifted;
+		}
+		if (count != 1) {
+			*tag |= TAG_COUNT;
+			p = put_varint(p, count);
+		}
+		if (e->cpu != cpu) {
+			*tag |= TAG_CPU;
+			cpu = e->cpu;
+			p = put_varint(p, cpu);
+		}
+		if (timed) {
+			p = put_varint(p, zigzag(e->time - time));
+			time = e->time;
+		}
+	}
+	header.size = p - tw->encoded;
+
+	fwrite(&header, sizeof(header), 1, tw->file);
+	fwrite(tw->encoded, 1, header.size, tw->file);
+	tw->num_tasks_written = tw->tasks->num_tasks;
+	tw->block_records = 0;
+}
+
+// num_cpus is the number of per-CPU drop counters to make room for, and filter
+// describes the events that were left out, NULL or empty if none were. The
+// CSV format has nowhere to put either.
+struct trace_writer *trace_writer_open(const char *path, enum trace_format format, int num_cpus, const char *filter) {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		return NULL;
+	}
+
+	setvbuf(file, NULL, _IOFBF, TRACE_WRITER_BUFFER_SIZE);
+
+	struct trace_writer *tw = (struct trace_writer *)malloc(sizeof(struct trace_writer));
+	tw->file = file;
+	tw->format = format;
+	tw->num_records = 0;
+	tw->num_cpus = format != TRACE_CSV ? num_cpus : 0;
+	tw->dropped = (uint64_t *)calloc(tw->num_cpus ? tw->num_cpus : 1, sizeof(uint64_t));
+	tw->block = NULL;
+	tw->block_records = 0;
+	tw->tasks = NULL;
+	tw->num_tasks_written = 0;
+	tw->encoded = NULL;
+
+	if (format == TRACE_COMPACT) {
+		tw->block = (struct event *)malloc(TRACE_BLOCK_RECORDS * sizeof(struct event));
+		tw->tasks = task_table_init();
+		tw->encoded = (unsigned char *)malloc(TRACE_BLOCK_RECORDS * (RECORD_MAX_ENCODED + TASK_MAX_ENCODED));
+	}
+
+	if (format != TRACE_CSV) {
+		struct trace_header header;
+		memset(&header, 0, sizeof(header));
+		if (format == TRACE_COMPACT) {
+			memcpy(header.magic, TRACE_COMPACT_MAGIC, sizeof(TRACE_COMPACT_MAGIC));
+		} else {
+			memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+			header.record_size = sizeof(struct trace_record);
+		}
+		header.version = TRACE_VERSION;
+		size_t filter_size = filter && *filter ? strlen(filter) + 1 : 0;
+		header.header_size = sizeof(struct trace_header) + tw->num_cpus * sizeof(uint64_t) + filter_size;
+		header.num_cpus = tw->num_cpus;
+		fwrite(&header, sizeof(header), 1, file);
+		fwrite(tw->dropped, sizeof(uint64_t), tw->num_cpus, file);
+		fwrite(filter, 1, filter_size, file);
+	}
+
+	return tw;
+}
+
+void trace_writer_write(struct trace_writer *tw, const struct event *e) {
+	if (tw->format == TRACE_CSV) {
+		// CSV has no count column, so a weighted access is written once per access
+		unsigned int count = e->count ? e->count : 1;
+		for (unsigned int i = 0; i < count; i++) {
+			fprintf(tw->file, "%lu,%d,%d,%d,%s\n", e->data, e->type, e->key.uid, e->key.pid, e->key.command);
+		}
+	} else if (tw->format == TRACE_COMPACT) {
+		tw->block[tw->block_records++] = *e;
+		if (tw->block_records == TRACE_BLOCK_RECORDS) {
+			trace_writer_flush_block(tw);
+		}
+	} else {
+		struct trace_record record;
+		record.folio = e->data;
+		record.type = e->type;
+		record.uid = e->key.uid;
+		record.pid = e->key.pid;
+		memcpy(record.command, e->key.command, sizeof(record.command));
+		record.count = e->count ? e->count : 1;
+		record.time = e->time;
+		record.cpu = e->cpu;
+		fwrite(&record, sizeof(record), 1, tw->file);
+	}
+	tw->num_records++;
+}
+
+// Sets the per-CPU drop counts written to the header on close
+void trace_writer_set_dropped(struct trace_writer *tw, const uint64_t *dropped) {
+	memcpy(tw->dropped, dropped, tw->num_cpus * sizeof(uint64_t));
+}
+
+void trace_writer_close(struct trace_writer *tw) {
+	if (tw->format == TRACE_COMPACT) {
+		trace_writer_flush_block(tw);
+		task_table_destroy(tw->tasks);
+		free(tw->block);
+		free(tw->encoded);
+	}
+	if (tw->format != TRACE_CSV) {
+		// Readers don't rely on num_records, but it lets tools check a trace is complete
+		uint64_t num_records = tw->num_records;
+		fseek(tw->file, offsetof(struct trace_header, num_records), SEEK_SET);
+		fwrite(&num_records, sizeof(num_records), 1, tw->file);
+		fseek(tw->file, sizeof(struct trace_header), SEEK_SET);
+		fwrite(tw->dropped, sizeof(uint64_t), tw->num_cpus, tw->file);
+	}
+	fclose(tw->file);
+	free(tw->dropped);
+	free(tw);
+}
+
+
+// Decodes the task definitions of block into tr->tasks. Returns 0 if they are corrupt.
+static int trace_reader_read_tasks(struct trace_reader *tr, const char *block, unsigned int *size) {
+	const struct trace_block_header *header = (const struct trace_block_header *)block;
+	const unsigned char *p = (const unsigned char *)(header + 1);
+	const unsigned char *end = p + header->tasks_size;
+	if (header->tasks_size > header->size) {
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < header->num_tasks; i++) {
+		if (tr->num_tasks == *size) {
+			*size *= 2;
+			tr->tasks = (struct task_key *)realloc(tr->tasks, *size * sizeof(struct task_key));
+		}
+		struct task_key *key = &tr->tasks[tr->num_tasks];
+		uint64_t uid, pid;
+		memset(key, 0, sizeof(struct task_key));
+		if (!(p = get_varint(p, end, &uid)) || !(p = get_varint(p, end, &pid)) ||
+		    p >= end || *p >= sizeof(key->command) || end - (p + 1) < *p) {
+			return 0;
+		}
+		key->uid = uid;
+		key->pid = pid;
+		memcpy(key->command, p + 1, *p);
+		p += 1 + *p;
+		tr->num_tasks++;
+	}
+	return 1;
+}
+
+// Finds every complete block of a compact trace and reads its task definitions.
+// A trace from a writer that never closed may end in a partial block.
+static void trace_reader_index_blocks(struct trace_reader *tr) {
+	unsigned long blocks_size = 64;
+	unsigned int tasks_size = 64;
+	tr->blocks = (const char **)malloc(blocks_size * sizeof(const char *));
+	tr->tasks = (struct task_key *)malloc(tasks_size * sizeof(struct task_key));
+
+	const char *block = tr->start;
+	while (tr->end - block >= sizeof(struct trace_block_header)) {
+		const struct trace_block_header *header = (const struct trace_block_header *)block;
+		if (header->size > tr->end - block - sizeof(struct trace_block_header) ||
+		    header->num_records > TRACE_BLOCK_RECORDS ||
+		    !trace_reader_read_tasks(tr, block, &tasks_size)) {
+			break;
+		}
+		if (tr->num_blocks == blocks_size) {
+			blocks_size *= 2;
+			tr->blocks = (const char **)realloc(tr->blocks, blocks_size * sizeof(const char *));
+		}
+		tr->blocks[tr->num_blocks++] = block;
+		block += sizeof(struct trace_block_header) + header->size;
+	}
+}
+
+static void trace_block_cursor_init(struct trace_block_cursor *c, const char *block) {
+	const struct trace_block_header *header = (const struct trace_block_header *)block;
+	const unsigned char *start = (const unsigned char *)(header + 1);
+	c->next = start + header->tasks_size;
+	c->end = start + header->size;
+	c->remaining = header->num_records;
+	c->task = UINT32_MAX;
+	c->folio = 0;
+	c->folio_shift = header->folio_shift;
+	c->flags = header->flags;
+	c->time = 0;
+	c->cpu = 0;
+}
+
+// Decodes the cursor's next record into e, which must be cleared. Returns 0
+// at the end of the block, or if the rest of it is corrupt.
+static int trace_block_cursor_next(struct trace_reader *tr, struct trace_block_cursor *c, struct event *e) {
+	if (!c->remaining || c->next >= c->end) {
+		return 0;
+	}
+	unsigned char tag = *c->next++;
+	uint64_t v;
+	e->type = tag & TAG_TYPE;
+	if (tag & TAG_TASK) {
+		if (!(c->next = get_varint(c->next, c->end, &v))) {
+			return 0;
+		}
+		c->task = v < tr->num_tasks ? v : UINT32_MAX;
+	}
+	if (c->task >= tr->num_tasks || !(c->next = get_varint(c->next, c->end, &v))) {
+		return 0;
+	}
+	e->key = tr->tasks[c->task];
+	if (e->type == SFL) {
+		e->num_evicted = v;
+	} else {
+		c->folio += unzigzag(v);
+		e->folio = c->folio << c->folio_shift;
+	}
+	e->count = 1;
+	if (tag & TAG_COUNT) {
+		if (!(c->next = get_varint(c->next, c->end, &v))) {
+			return 0;
+		}
+		e->count = v;
+	}
+	if (tag & TAG_CPU) {
+		if (!(c->next = get_varint(c->next, c->end, &v))) {
+			return 0;
+		}
+		c->cpu = v;
+	}
+	e->cpu = c->cpu;
+	if (c->flags & TRACE_BLOCK_TIMED) {
+		if (!(c->next = get_varint(c->next, c->end, &v))) {
+			return 0;
+		}
+		c->time += unzigzag(v);
+		e->time = c->time;
+	}
+	c->remaining--;
+	return 1;
+}
+
+// Recognizes a binary or compact trace by its header, returning 0 if the map is neither
+static int trace_reader_parse_header(struct trace_reader *tr) {
+	const struct trace_header *header = (const struct trace_header *)tr->map;
+	if (tr->map_size < sizeof(struct trace_header)) {
+		return 0;
+	}
+	bool compact = !memcmp(header->magic, TRACE_COMPACT_MAGIC, sizeof(TRACE_COMPACT_MAGIC));
+	if ((!compact && memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC))) ||
+	    header->version > TRACE_VERSION ||
+	    header->header_size > tr->map_size ||
+	    header->header_size < sizeof(struct trace_header) + header->num_cpus * sizeof(uint64_t) ||
+	    (!compact && header->record_size < TRACE_RECORD_MIN_SIZE)) {
+		return 0;
+	}
+
+	tr->start = tr->map + header->header_size;
+	tr->next = tr->start;
+	if (compact) {
+		tr->format = TRACE_COMPACT;
+		trace_reader_index_blocks(tr);
+	} else {
+		// A trace from a writer that never closed may end in a partial record
+		size_t num_records = (tr->map_size - header->header_size) / header->record_size;
+		tr->format = TRACE_BINARY;
+		tr->end = tr->start + num_records * header->record_size;
+		tr->record_size = header->record_size;
+	}
+	tr->num_cpus = header->num_cpus;
+	tr->dropped = (const uint64_t *)(tr->map + sizeof(struct trace_header));
+	const char *filter = (const char *)(tr->dropped + tr->num_cpus);
+	size_t filter_size = tr->map + header->header_size - filter;
+	if (filter_size && memchr(filter, '\0', filter_size)) {
+		tr->filter = filter;
+	}
+	return 1;
+}
+
+// Opens a trace in any format. Binary and compact traces are recognized by their magic,
+// anything else is read as CSV.
+struct trace_reader *trace_reader_open(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	struct trace_reader *tr = (struct trace_reader *)malloc(sizeof(struct trace_reader));
+	memset(tr, 0, sizeof(struct trace_reader));
+	tr->filter = "";
+	if (st.st_size) {
+		tr->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (tr->map == MAP_FAILED) {
+			close(fd);
+			free(tr);
+			return NULL;
+		}
+		tr->map_size = st.st_size;
+		madvise((void *)tr->map, tr->map_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	tr->end = tr->map + tr->map_size;
+	if (!trace_reader_parse_header(tr)) {
+		tr->format = TRACE_CSV;
+		tr->start = tr->map;
+		tr->next = tr->start;
+	}
+	return tr;
+}
+
+static const char *skip_space(const char *p, const char *end) {
+	while (p < end && (*p == '\n' || *p == '\r' || *p == ' ' || *p == '\t')) {
+		p++;
+	}
+	return p;
+}
+
+static const char *parse_unsigned(const char *p, const char *end, unsigned long *v) {
+	if (p == end || *p < '0' || *p > '9') {
+		return NULL;
+	}
+	unsigned long result = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		result = result * 10 + (*p++ - '0');
+	}
+	*v = result;
+	return p;
+}
+
+// Parses the CSV line at p, which must not start with whitespace, into e.
+// Returns the start of the next line, or NULL if the line is malformed.
+static const char *parse_csv_line(const char *p, const char *end, struct event *e) {
+	unsigned long fields[4];
+	for (int i = 0; i < 4; i++) {
+		if (!(p = parse_unsigned(p, end, &fields[i])) || p == end || *p++ != ',') {
+			return NULL;
+		}
+	}
+	e->data = fields[0];
+	e->type = fields[1];
+	e->key.uid = fields[2];
+	e->key.pid = fields[3];
+
+	// The command runs to the end of the line and may contain commas. A line
+	// without its newline may still be being written, so it ends the trace.
+	const char *line_end = memchr(p, '\n', end - p);
+	if (!line_end) {
+		return NULL;
+	}
+	size_t len = line_end - p;
+	if (len && p[len - 1] == '\r') {
+		len--;
+	}
+	if (!len) {
+		return NULL;
+	}
+	if (len > sizeof(e->key.command) - 1) {
+		len = sizeof(e->key.command) - 1;
+	}
+	memcpy(e->key.command, p, len);
+	return line_end + 1;
+}
+
+static void decode_record(struct trace_reader *tr, const char *next, struct event *e) {
+	const struct trace_record *record = (const struct trace_record *)next;
+	e->data = record->folio;
+	e->type = record->type;
+	e->key.uid = record->uid;
+	e->key.pid = record->pid;
+	memcpy(e->key.command, record->command, sizeof(e->key.command));
+	e->key.command[sizeof(e->key.command) - 1] = '\0';
+	if (tr->record_size >= offsetof(struct trace_record, time) && record->count) {
+		e->count = record->count;
+	}
+	if (tr->record_size >= sizeof(struct trace_record)) {
+		e->time = record->time;
+		e->cpu = record->cpu;
+	}
+}
+
+// Decodes the next event into e. Returns 1 on success and 0 at the end of the trace.
+int trace_reader_next(struct trace_reader *tr, struct event *e) {
+	// Clear the whole event so the unused bytes of key.command don't make
+	// otherwise identical task keys hash differently
+	memset(e, 0, sizeof(struct event));
+
+	e->count = 1;
+	if (tr->format == TRACE_CSV) {
+		// Decoding stops at the first malformed line
+		const char *line = skip_space(tr->next, tr->end);
+		if (line == tr->end || !(tr->next = parse_csv_line(line, tr->end, e))) {
+			tr->next = tr->end;
+			return 0;
+		}
+		return 1;
+	}
+	if (tr->format == TRACE_COMPACT) {
+		// A corrupt block is cut short, and decoding carries on with the next one
+		while (!trace_block_cursor_next(tr, &tr->cursor, e)) {
+			if (tr->next_block == tr->num_blocks) {
+				return 0;
+			}
+			trace_block_cursor_init(&tr->cursor, tr->blocks[tr->next_block++]);
+		}
+		return 1;
+	}
+
+	if (tr->next >= tr->end) {
+		return 0;
+	}
+	decode_record(tr, tr->next, e);
+	tr->next += tr->record_size;
+	return 1;
+}
+
+// Decodes a whole block of a compact trace into events, which must have room for
+// TRACE_BLOCK_RECORDS. Returns the number of events decoded. Doesn't touch the
+// reader's position, so threads can decode different blocks at once.
+unsigned int trace_reader_read_block(struct trace_reader *tr, unsigned long block, struct event *events) {
+	struct trace_block_cursor c;
+	unsigned int num_events = 0;
+	trace_block_cursor_init(&c, tr->blocks[block]);
+	memset(events, 0, c.remaining * sizeof(struct event));
+	while (trace_block_cursor_next(tr, &c, &events[num_events])) {
+		num_events++;
+	}
+	return num_events;
+}
+
+// Chunks split a trace into pieces that decode on their own, in order
+unsigned long trace_reader_num_chunks(struct trace_reader *tr) {
+	switch (tr->format) {
+		case TRACE_CSV:
+			return (tr->map_size + TRACE_CSV_CHUNK_SIZE - 1) / TRACE_CSV_CHUNK_SIZE;
+		case TRACE_BINARY:
+			return ((tr->end - tr->start) / tr->record_size + TRACE_BLOCK_RECORDS - 1) / TRACE_BLOCK_RECORDS;
+		case TRACE_COMPACT:
+			return tr->num_blocks;
+	}
+	return 0;
+}
+
+// CSV chunks start at the first line that begins at or after their offset
+static const char *csv_chunk_start(struct trace_reader *tr, unsigned long chunk) {
+	size_t offset = chunk * TRACE_CSV_CHUNK_SIZE;
+	if (!offset) {
+		return tr->map;
+	}
+	if (offset >= tr->map_size) {
+		return tr->end;
+	}
+	const char *newline = memchr(tr->map + offset - 1, '\n', tr->map_size - offset + 1);
+	return newline ? newline + 1 : tr->end;
+}
+
+// Byte offset of the start of chunk in the file. Appending to a trace doesn't
+// move the chunks before its end, so this is where a replay can resume.
+size_t trace_reader_chunk_offset(struct trace_reader *tr, unsigned long chunk) {
+	switch (tr->format) {
+		case TRACE_CSV:
+			return csv_chunk_start(tr, chunk) - tr->map;
+		case TRACE_BINARY:
+			if (chunk >= trace_reader_num_chunks(tr)) {
+				return tr->end - tr->map;
+			}
+			return tr->start + chunk * TRACE_BLOCK_RECORDS * tr->record_size - tr->map;
+		case TRACE_COMPACT:
+			return chunk < tr->num_blocks ? tr->blocks[chunk] - tr->map : tr->end - tr->map;
+	}
+	return 0;
+}
+
+// Time of the first event of chunk, 0 if there is none or the trace has no
+// times. CSV traces never do.
+uint64_t trace_reader_chunk_time(struct trace_reader *tr, unsigned long chunk) {
+	if (chunk >= trace_reader_num_chunks(tr)) {
+		return 0;
+	}
+	if (tr->format == TRACE_BINARY) {
+		if (tr->record_size < sizeof(struct trace_record)) {
+			return 0;
+		}
+		const struct trace_record *record = (const struct trace_record *)(tr->start + chunk * TRACE_BLOCK_RECORDS * tr->record_size);
+		return record->time;
+	}
+	if (tr->format == TRACE_COMPACT) {
+		struct trace_block_cursor c;
+		struct event e;
+		memset(&e, 0, sizeof(e));
+		trace_block_cursor_init(&c, tr->blocks[chunk]);
+		return trace_block_cursor_next(tr, &c, &e) ? e.time : 0;
+	}
+	return 0;
+}
+
+/*
+ * Finds the last chunk that starts at or before time, or 0 if they all start
+ * after it. The first event of every chunk makes a sparse index from time to
+ * offset, searched by bisection, so only a few chunks are looked at however
+ * long the trace is. Events are in time order, except that events from
+ * different CPUs can be slightly out of order, so callers should allow a
+ * chunk either side.
+ */
+unsigned long trace_reader_find_chunk(struct trace_reader *tr, uint64_t time) {
+	unsigned long low = 0;
+	unsigned long high = trace_reader_num_chunks(tr);
+	while (high - low > 1) {
+		unsigned long mid = low + (high - low) / 2;
+		if (trace_reader_chunk_time(tr, mid) <= time) {
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static void reserve_events(struct event **events, unsigned long *size, unsigned long needed) {
+	if (*size >= needed) {
+		return;
+	}
+	if (!*size) {
+		*size = TRACE_BLOCK_RECORDS;
+	}
+	while (*size < needed) {
+		*size *= 2;
+	}
+	*events = (struct event *)realloc(*events, *size * sizeof(struct event));
+}
+
+/*
+ * Decodes one chunk into *events, growing it and *size as needed, and sets
+ * *num_events. Returns 0 if the chunk was cut short by corrupt data, after
+ * which the trace should be treated as ending. Doesn't touch the reader's
+ * position, so threads can decode different chunks at once.
+ */
+int trace_reader_read_chunk(struct trace_reader *tr, unsigned long chunk, struct event **events, unsigned long *size, unsigned long *num_events) {
+	*num_events = 0;
+	if (tr->format == TRACE_COMPACT) {
+		reserve_events(events, size, TRACE_BLOCK_RECORDS);
+		*num_events = trace_reader_read_block(tr, chunk, *events);
+		return *num_events == ((const struct trace_block_header *)tr->blocks[chunk])->num_records;
+	}
+
+	if (tr->format == TRACE_BINARY) {
+		const char *next = tr->start + chunk * TRACE_BLOCK_RECORDS * tr->record_size;
+		unsigned long n = (tr->end - next) / tr->record_size;
+		n = n < TRACE_BLOCK_RECORDS ? n : TRACE_BLOCK_RECORDS;
+		reserve_events(events, size, n);
+		memset(*events, 0, n * sizeof(struct event));
+		for (unsigned long i = 0; i < n; i++, next += tr->record_size) {
+			(*events)[i].count = 1;
+			decode_record(tr, next, &(*events)[i]);
+		}
+		*num_events = n;
+		return 1;
+	}
+
+	const char *p = csv_chunk_start(tr, chunk);
+	const char *end = csv_chunk_start(tr, chunk + 1);
+	while ((p = skip_space(p, end)) < end) {
+		reserve_events(events, size, *num_events + 1);
+		struct event *e = &(*events)[*num_events];
+		memset(e, 0, sizeof(struct event));
+		e->count = 1;
+		if (!(p = parse_csv_line(p, end, e))) {
+			return 0;
+		}
+		(*num_events)++;
+	}
+	return 1;
+}
+
+// Total number of events the profiler lost while recording the trace
+uint64_t trace_reader_dropped(struct trace_reader *tr) {
+	uint64_t dropped = 0;
+	for (int cpu = 0; cpu < tr->num_cpus; cpu++) {
+		dropped += tr->dropped[cpu];
+	}
+	return dropped;
+}
+
+void trace_reader_close(struct trace_reader *tr) {
+	if (tr->map) {
+		munmap((void *)tr->map, tr->map_size);
+	}
+	free(tr->blocks);
+	free(tr->tasks);
+	free(tr);
+}
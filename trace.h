@@ -0,0 +1,154 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "common.h"
+
+/*
+ * Binary trace layout: a trace_header followed by fixed-size trace_records.
+ * Readers locate the first record with header_size and step through records
+ * with record_size, so later versions can append fields to either struct
+ * without breaking older readers.
+ */
+#define TRACE_MAGIC "CSIMTRC"
+// Version 2 added event times and CPUs
+#define TRACE_VERSION 2
+// Compact traces share trace_header but are a series of trace_blocks instead
+// of fixed-size records, see trace.c for the encoding
+#define TRACE_COMPACT_MAGIC "CSIMTRZ"
+// Records per compact block, the unit of random access and parallel decode
+#define TRACE_BLOCK_RECORDS 65536
+// Bytes of CSV per chunk, see trace_reader_read_chunk. Binary chunks are
+// TRACE_BLOCK_RECORDS records and compact chunks are one block.
+#define TRACE_CSV_CHUNK_SIZE (4 << 20)
+// stdio buffer for trace writers, so records go to disk in large writes
+#define TRACE_WRITER_BUFFER_SIZE (1 << 20)
+
+struct trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	// Number of per-CPU drop counters that follow the header
+	uint32_t num_cpus;
+	// Filled in when the writer is closed, 0 if it never was
+	uint64_t num_records;
+	// Followed by uint64_t dropped[num_cpus]: events the profiler lost on
+	// each CPU, also filled in when the writer is closed. The rest of
+	// header_size, if any, holds the NUL-terminated description of the
+	// profiler's filter.
+} __attribute__((packed));
+
+struct trace_record {
+	uint64_t folio;
+	uint32_t type;
+	uint32_t uid;
+	uint32_t pid;
+	char command[16];
+	// Older traces end here, and every record stands for one access
+	uint32_t count;
+	// Version 1 traces end here, and have no times
+	uint64_t time;
+	uint32_t cpu;
+} __attribute__((packed));
+
+#define TRACE_RECORD_MIN_SIZE offsetof(struct trace_record, count)
+
+// Every block decodes on its own, given the tasks defined by the blocks before it
+struct trace_block_header {
+	// Bytes of task definitions and records following this header
+	uint32_t size;
+	uint32_t num_records;
+	// Tasks first seen in this block. They are defined ahead of the records,
+	// in tasks_size bytes, and take the next ids after earlier blocks' tasks.
+	uint32_t num_tasks;
+	uint32_t tasks_size;
+	// Folios in the block are stored shifted right by this many bits
+	uint8_t folio_shift;
+	// TRACE_BLOCK_TIMED if the records carry times and CPUs. 0 in version 1.
+	uint8_t flags;
+	uint8_t reserved[2];
+} __attribute__((packed));
+
+#define TRACE_BLOCK_TIMED 1
+
+enum trace_format {
+	TRACE_BINARY,
+	TRACE_CSV,
+	TRACE_COMPACT,
+};
+
+struct task_table;
+
+struct trace_writer {
+	FILE *file;
+	enum trace_format format;
+	unsigned long num_records;
+	int num_cpus;
+	uint64_t *dropped;
+	// TRACE_COMPACT: events of the block being filled, and the tasks seen so
+	// far, of which the first num_tasks_written are defined in earlier blocks
+	struct event *block;
+	unsigned int block_records;
+	struct task_table *tasks;
+	unsigned int num_tasks_written;
+	unsigned char *encoded;
+};
+
+// Decoding state within one compact block
+struct trace_block_cursor {
+	const unsigned char *next;
+	const unsigned char *end;
+	unsigned int remaining;
+	unsigned int task;
+	uint64_t folio;
+	uint8_t folio_shift;
+	uint8_t flags;
+	uint64_t time;
+	unsigned int cpu;
+};
+
+struct trace_reader {
+	enum trace_format format;
+	// Every format is mapped, NULL if the file is empty
+	const char *map;
+	size_t map_size;
+	// The first record, block or line, the next one to decode and the end
+	const char *start;
+	const char *next;
+	const char *end;
+	uint32_t record_size;
+	// Events lost while recording, per CPU. Always 0 CPUs for CSV.
+	int num_cpus;
+	const uint64_t *dropped;
+	// Empty if the profiler recorded every task
+	const char *filter;
+	// TRACE_COMPACT: the start of every complete block, and every task they
+	// define, indexed when the trace is opened
+	const char **blocks;
+	unsigned long num_blocks;
+	unsigned long next_block;
+	struct trace_block_cursor cursor;
+	struct task_key *tasks;
+	unsigned int num_tasks;
+};
+
+
+struct trace_writer *trace_writer_open(const char *path, enum trace_format format, int num_cpus, const char *filter);
+void trace_writer_write(struct trace_writer *tw, const struct event *e);
+void trace_writer_set_dropped(struct trace_writer *tw, const uint64_t *dropped);
+void trace_writer_close(struct trace_writer *tw);
+struct trace_reader *trace_reader_open(const char *path);
+int trace_reader_next(struct trace_reader *tr, struct event *e);
+unsigned int trace_reader_read_block(struct trace_reader *tr, unsigned long block, struct event *events);
+unsigned long trace_reader_num_chunks(struct trace_reader *tr);
+size_t trace_reader_chunk_offset(struct trace_reader *tr, unsigned long chunk);
+uint64_t trace_reader_chunk_time(struct trace_reader *tr, unsigned long chunk);
+unsigned long trace_reader_find_chunk(struct trace_reader *tr, uint64_t time);
+int trace_reader_read_chunk(struct trace_reader *tr, unsigned long chunk, struct event **events, unsigned long *size, unsigned long *num_events);
+uint64_t trace_reader_dropped(struct trace_reader *tr);
+void trace_reader_close(struct trace_reader *tr);
+
+#endif
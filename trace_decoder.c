@@ -0,0 +1,137 @@
+#include "trace_decoder.h"
+#include <stdlib.h>
+
+
+void *trace_decoder_thread(void *arg) {
+	struct trace_decoder *td = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&td->lock);
+		while (!td->done && td->claimed < td->num_chunks && td->claimed >= td->consumed + td->depth) {
+			pthread_cond_wait(&td->slot_free, &td->lock);
+		}
+		if (td->done || td->claimed >= td->num_chunks) {
+			pthread_mutex_unlock(&td->lock);
+			break;
+		}
+		unsigned long chunk = td->claimed++;
+		pthread_mutex_unlock(&td->lock);
+
+		// Nothing else touches the slot until it is marked ready
+		struct trace_decoder_slot *slot = &td->slots[chunk % td->depth];
+		slot->complete = trace_reader_read_chunk(td->tr, chunk, &slot->events, &slot->size, &slot->num_events);
+
+		pthread_mutex_lock(&td->lock);
+		slot->ready = chunk + 1;
+		pthread_cond_broadcast(&td->chunk_ready);
+		pthread_mutex_unlock(&td->lock);
+	}
+	return NULL;
+}
+
+// Decodes the chunks from first_chunk up to end_chunk, or to the end of the
+// trace if it comes first
+struct trace_decoder *trace_decoder_init(struct trace_reader *tr, unsigned long first_chunk, unsigned long end_chunk, int num_threads) {
+	struct trace_decoder *td = (struct trace_decoder *)malloc(sizeof(struct trace_decoder));
+	td->tr = tr;
+	td->num_chunks = trace_reader_num_chunks(tr);
+	if (end_chunk < td->num_chunks) {
+		td->num_chunks = end_chunk;
+	}
+	td->num_threads = num_threads;
+	td->depth = num_threads ? num_threads * TRACE_DECODER_DEPTH : 1;
+	td->slots = (struct trace_decoder_slot *)calloc(td->depth, sizeof(struct trace_decoder_slot));
+	td->threads = NULL;
+	td->claimed = first_chunk;
+	td->consumed = first_chunk;
+	td->holding = 0;
+	td->done = 0;
+	if (!num_threads) {
+		return td;
+	}
+
+	pthread_mutex_init(&td->lock, NULL);
+	pthread_cond_init(&td->chunk_ready, NULL);
+	pthread_cond_init(&td->slot_free, NULL);
+	td->threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+	for (int i = 0; i < num_threads; i++) {
+		pthread_create(&td->threads[i], NULL, trace_decoder_thread, td);
+	}
+	return td;
+}
+
+// Gives the slot of chunk consumed back to the threads
+void trace_decoder_release(struct trace_decoder *td) {
+	if (!td->num_threads) {
+		td->consumed++;
+		return;
+	}
+	pthread_mutex_lock(&td->lock);
+	td->consumed++;
+	pthread_cond_broadcast(&td->slot_free);
+	pthread_mutex_unlock(&td->lock);
+}
+
+// Stops handing out chunks after the one being consumed
+void trace_decoder_truncate(struct trace_decoder *td) {
+	if (!td->num_threads) {
+		td->num_chunks = td->consumed + 1;
+		return;
+	}
+	pthread_mutex_lock(&td->lock);
+	td->num_chunks = td->consumed + 1;
+	pthread_cond_broadcast(&td->slot_free);
+	pthread_mutex_unlock(&td->lock);
+}
+
+// Returns the events of the next chunk, valid until the next call, or NULL at
+// the end of the trace
+const struct event *trace_decoder_next(struct trace_decoder *td, unsigned long *num_events) {
+	if (td->holding) {
+		td->holding = 0;
+		trace_decoder_release(td);
+	}
+
+	while (td->consumed < td->num_chunks) {
+		struct trace_decoder_slot *slot = &td->slots[td->consumed % td->depth];
+		if (!td->num_threads) {
+			slot->complete = trace_reader_read_chunk(td->tr, td->consumed, &slot->events, &slot->size, &slot->num_events);
+		} else {
+			pthread_mutex_lock(&td->lock);
+			while (slot->ready != td->consumed + 1) {
+				pthread_cond_wait(&td->chunk_ready, &td->lock);
+			}
+			pthread_mutex_unlock(&td->lock);
+		}
+
+		// Like trace_reader_next, the trace ends at the first corrupt data
+		if (!slot->complete) {
+			trace_decoder_truncate(td);
+		}
+		if (slot->num_events) {
+			td->holding = 1;
+			*num_events = slot->num_events;
+			return slot->events;
+		}
+		trace_decoder_release(td);
+	}
+	return NULL;
+}
+
+void trace_decoder_destroy(struct trace_decoder *td) {
+	if (td->num_threads) {
+		pthread_mutex_lock(&td->lock);
+		td->done = 1;
+		pthread_cond_broadcast(&td->slot_free);
+		pthread_mutex_unlock(&td->lock);
+		for (int i = 0; i < td->num_threads; i++) {
+			pthread_join(td->threads[i], NULL);
+		}
+		free(td->threads);
+	}
+	for (int i = 0; i < td->depth; i++) {
+		free(td->slots[i].events);
+	}
+	free(td->slots);
+	free(td);
+}
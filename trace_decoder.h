@@ -0,0 +1,53 @@
+#ifndef TRACE_DECODER_H
+#define TRACE_DECODER_H
+
+#include <pthread.h>
+#include "common.h"
+#include "trace.h"
+
+// Chunks each decoder thread may run ahead of the caller, bounds decoder memory
+#define TRACE_DECODER_DEPTH 2
+
+
+struct trace_decoder_slot {
+	struct event *events;
+	unsigned long size;
+	unsigned long num_events;
+	// chunk + 1 once the chunk in this slot is decoded
+	unsigned long ready;
+	// 0 if the chunk was cut short by corrupt data
+	int complete;
+};
+
+/*
+ * Decodes a trace chunk by chunk on a pool of threads and hands the chunks
+ * to the caller in trace order. Threads claim chunks in order and decode
+ * each into its own slot, at most depth chunks ahead of the one the caller
+ * holds. With no threads, each chunk is decoded by the caller when it asks
+ * for it.
+ */
+struct trace_decoder {
+	struct trace_reader *tr;
+	unsigned long num_chunks;
+	int num_threads;
+	pthread_t *threads;
+	struct trace_decoder_slot *slots;
+	int depth;
+	// Chunks claimed by threads, and chunks the caller is done with. consumed
+	// is also the chunk of the events trace_decoder_next last returned.
+	unsigned long claimed;
+	unsigned long consumed;
+	// Whether the caller holds chunk consumed
+	int holding;
+	int done;
+	pthread_mutex_t lock;
+	pthread_cond_t chunk_ready;
+	pthread_cond_t slot_free;
+};
+
+
+struct trace_decoder *trace_decoder_init(struct trace_reader *tr, unsigned long first_chunk, unsigned long end_chunk, int num_threads);
+const struct event *trace_decoder_next(struct trace_decoder *td, unsigned long *num_events);
+void trace_decoder_destroy(struct trace_decoder *td);
+
+#endif
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "trace.h"
+
+
+struct tracecvt_opts {
+	bool c;
+	bool z;
+};
+
+
+long file_size(const char *path) {
+	struct stat st;
+	return stat(path, &st) ? 0 : st.st_size;
+}
+
+
+int main(int argc, char **argv) {
+	struct tracecvt_opts flags;
+	flags.c = false;
+	flags.z = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "cz")) != -1) {
+		switch(opt) {
+			case 'c':
+				flags.c = true;
+				break;
+			case 'z':
+				flags.z = true;
+				break;
+			case '?':
+				printf("Usage: %s [-c | -z] <input> <output>\n", argv[0]);
+				printf("-c: Write CSV instead of the binary trace format\n");
+				printf("-z: Write the compact trace format instead of the binary trace format\n");
+				return 1;
+		}
+	}
+	if (argc - optind != 2 || (flags.c && flags.z)) {
+		printf("Usage: %s [-c | -z] <input> <output>\n", argv[0]);
+		return 1;
+	}
+
+	struct trace_reader *in = trace_reader_open(argv[optind]);
+	if (!in) {
+		printf("Failed to open %s\n", argv[optind]);
+		return 1;
+	}
+	struct trace_writer *out = trace_writer_open(argv[optind + 1], flags.c ? TRACE_CSV : flags.z ? TRACE_COMPACT : TRACE_BINARY, in->num_cpus, in->filter);
+	if (!out) {
+		printf("Failed to open %s\n", argv[optind + 1]);
+		trace_reader_close(in);
+		return 1;
+	}
+
+	struct event e;
+	while (trace_reader_next(in, &e)) {
+		trace_writer_write(out, &e);
+	}
+	unsigned long num_records = out->num_records;
+	if (out->num_cpus) {
+		trace_writer_set_dropped(out, in->dropped);
+	}
+
+	trace_writer_close(out);
+	trace_reader_close(in);
+
+	long in_size = file_size(argv[optind]);
+	long out_size = file_size(argv[optind + 1]);
+	printf("Converted %lu events, %ld bytes to %ld bytes (%.2fx)\n", num_records, in_size, out_size, out_size ? (double)in_size / out_size : 0.0);
+	return 0;
+}
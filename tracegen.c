@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include "common.h"
+#include "trace.h"
+#include "workload.h"
+
+// The tasks are spread over this many CPUs
+#define TRACEGEN_CPUS 4
+
+struct tracegen_opts {
+	bool c;
+	bool z;
+	unsigned long num_events;
+	// Events per second, which spaces out the event times
+	double rate;
+	struct workload_opts workload;
+};
+
+
+void print_usage(const char *name) {
+	printf("Usage: %s [-c | -z] [-w pattern] [-n events] [-f folios] [-t tasks] [-a alpha] [-s seed] [-r rate] <output>\n", name);
+	printf("-c: Write CSV instead of the binary trace format\n");
+	printf("-z: Write the compact trace format instead of the binary trace format\n");
+	printf("-w: Access pattern: zipf, uniform, loop, sequential or mixed (default zipf)\n");
+	printf("-n: Number of events (default 1000000)\n");
+	printf("-f: Folios in the working set, per task for mixed (default 262144)\n");
+	printf("-t: Number of tasks (default 4)\n");
+	printf("-a: Zipf exponent (default 0.9)\n");
+	printf("-s: Random seed, the same seed always gives the same trace\n");
+	printf("-r: Events per second, for the event times (default 1000000)\n");
+}
+
+
+int main(int argc, char **argv) {
+	struct tracegen_opts flags;
+	flags.c = false;
+	flags.z = false;
+	flags.num_events = 1000000;
+	flags.rate = 1000000;
+	flags.workload.pattern = WORKLOAD_ZIPF;
+	flags.workload.num_folios = 1 << 18;
+	flags.workload.num_tasks = 4;
+	flags.workload.alpha = 0.9;
+	flags.workload.seed = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "czw:n:f:t:a:s:r:")) != -1) {
+		switch(opt) {
+			case 'c':
+				flags.c = true;
+				break;
+			case 'z':
+				flags.z = true;
+				break;
+			case 'w': {
+				int pattern = workload_parse_pattern(optarg);
+				if (pattern < 0) {
+					printf("Unknown pattern: %s\n", optarg);
+					return 1;
+				}
+				flags.workload.pattern = pattern;
+				break;
+			}
+			case 'n':
+				flags.num_events = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				flags.workload.num_folios = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				flags.workload.num_tasks = strtoul(optarg, NULL, 10);
+				break;
+			case 'a':
+				flags.workload.alpha = strtod(optarg, NULL);
+				if (flags.workload.alpha <= 0) {
+					printf("Zipf exponent must be positive\n");
+					return 1;
+				}
+				break;
+			case 's':
+				flags.workload.seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'r':
+				flags.rate = strtod(optarg, NULL);
+				if (flags.rate <= 0) {
+					printf("Rate must be positive\n");
+					return 1;
+				}
+				break;
+			case '?':
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind != 1 || (flags.c && flags.z)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	struct trace_writer *out = trace_writer_open(argv[optind], flags.c ? TRACE_CSV : flags.z ? TRACE_COMPACT : TRACE_BINARY, 0, "");
+	if (!out) {
+		printf("Failed to open %s\n", argv[optind]);
+		return 1;
+	}
+
+	struct workload *w = workload_init(&flags.workload);
+	struct event e;
+	for (unsigned long n = 0; n < flags.num_events; n++) {
+		workload_next(w, &e);
+		// Times count from the epoch, one interval in, since a time of 0 means none
+		e.time = (n + 1) * 1e9 / flags.rate;
+		e.cpu = e.key.pid % TRACEGEN_CPUS;
+		trace_writer_write(out, &e);
+	}
+	workload_destroy(w);
+	trace_writer_close(out);
+
+	printf("Wrote %lu %s events to %s\n", flags.num_events, workload_pattern_names[flags.workload.pattern], argv[optind]);
+	return 0;
+}
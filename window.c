@@ -0,0 +1,187 @@
+#include "window.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+// Grows the per-task arrays to cover task_id. Tasks first seen after the
+// report started had no counts before, so they start from 0.
+static void window_report_reserve(struct window_report *wr, unsigned int task_id) {
+	if (task_id < wr->num_tasks) {
+		return;
+	}
+	unsigned int num_tasks = wr->num_tasks ? wr->num_tasks : 64;
+	while (task_id >= num_tasks) {
+		num_tasks *= 2;
+	}
+	wr->real_tasks = (struct linux_task_stats *)realloc(wr->real_tasks, num_tasks * sizeof(struct linux_task_stats));
+	memset(wr->real_tasks + wr->num_tasks, 0, (num_tasks - wr->num_tasks) * sizeof(struct linux_task_stats));
+	wr->sim_tasks = (struct task_stats *)realloc(wr->sim_tasks, (size_t)num_tasks * wr->num_sims * sizeof(struct task_stats));
+	memset(wr->sim_tasks + (size_t)wr->num_tasks * wr->num_sims, 0, (size_t)(num_tasks - wr->num_tasks) * wr->num_sims * sizeof(struct task_stats));
+	wr->active = (unsigned int *)realloc(wr->active, num_tasks * sizeof(unsigned int));
+	wr->window_active = (unsigned long *)realloc(wr->window_active, num_tasks * sizeof(unsigned long));
+	memset(wr->window_active + wr->num_tasks, 0, (num_tasks - wr->num_tasks) * sizeof(unsigned long));
+	wr->num_tasks = num_tasks;
+}
+
+// Takes the counts of task_id now as the start of its next window
+static void window_report_snapshot_task(struct window_report *wr, unsigned int task_id) {
+	wr->real_tasks[task_id] = wr->ls->task_stats[task_id];
+	for (int i = 0; i < wr->num_sims; i++) {
+		wr->sim_tasks[(size_t)task_id * wr->num_sims + i] = policy_simulation_task_stats(wr->sims[i], task_id);
+	}
+}
+
+static void window_report_snapshot_totals(struct window_report *wr) {
+	wr->real.fma = wr->ls->fma;
+	wr->real.faf = wr->ls->faf;
+	wr->real.fmd = wr->ls->fmd;
+	wr->real.mbd = wr->ls->mbd;
+	for (int i = 0; i < wr->num_sims; i++) {
+		wr->sim_totals[i].hits = wr->sims[i]->hits;
+		wr->sim_totals[i].misses = wr->sims[i]->misses;
+	}
+	wr->expected_accesses = wr->sampler ? wr->sampler->expected_accesses : 0;
+}
+
+// Opens path for the CSV and starts the first window at event start, from
+// whatever the simulations have replayed so far
+struct window_report *window_report_init(const char *path, struct policy_simulation **sims, int num_sims, const unsigned long *capacities, struct linux_stats *ls, struct sampler *sampler, unsigned long start) {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		return NULL;
+	}
+	struct window_report *wr = (struct window_report *)calloc(1, sizeof(struct window_report));
+	wr->file = file;
+	wr->sims = sims;
+	wr->num_sims = num_sims;
+	wr->capacities = capacities;
+	wr->ls = ls;
+	wr->sampler = sampler;
+	wr->start = start;
+	wr->sim_totals = (struct task_stats *)calloc(num_sims, sizeof(struct task_stats));
+	window_report_snapshot_totals(wr);
+	// A resumed replay already has counts for the tasks it has seen
+	if (ls->tasks->num_tasks) {
+		window_report_reserve(wr, ls->tasks->num_tasks - 1);
+	}
+	for (unsigned int id = 0; id < ls->tasks->num_tasks; id++) {
+		window_report_snapshot_task(wr, id);
+	}
+
+	fprintf(file, "window,start_time,start_event,end_event,command,pid,uid,policy,capacity,accesses,hit_percent\n");
+	return wr;
+}
+
+// Notes that task_id has an access in the current window
+void window_report_touch(struct window_report *wr, unsigned int task_id) {
+	window_report_reserve(wr, task_id);
+	if (wr->window_active[task_id] != wr->num_windows + 1) {
+		wr->window_active[task_id] = wr->num_windows + 1;
+		wr->active[wr->num_active++] = task_id;
+	}
+}
+
+// Follows a REPLAY_RESCALE, which multiplies every simulated count by factor.
+// The sampler only lowers its rate a logarithmic number of times, so going
+// over every task here is rare.
+void window_report_rescale(struct window_report *wr, double factor) {
+	for (int i = 0; i < wr->num_sims; i++) {
+		wr->sim_totals[i].hits = wr->sim_totals[i].hits * factor + 0.5;
+		wr->sim_totals[i].misses = wr->sim_totals[i].misses * factor + 0.5;
+	}
+	for (size_t i = 0; i < (size_t)wr->num_tasks * wr->num_sims; i++) {
+		wr->sim_tasks[i].hits = wr->sim_tasks[i].hits * factor + 0.5;
+		wr->sim_tasks[i].misses = wr->sim_tasks[i].misses * factor + 0.5;
+	}
+	wr->expected_accesses *= factor;
+}
+
+static void window_report_row(struct window_report *wr, unsigned long end, const struct task_key *key, const char *policy, unsigned long capacity, unsigned long accesses, float hit_percent) {
+	if (!accesses || isnan(hit_percent) || hit_percent < 0) {
+		return;
+	}
+	fprintf(wr->file, "%lu,", wr->num_windows);
+	if (wr->times) {
+		fprintf(wr->file, "%lu.%09lu", wr->start_time / 1000000000, wr->start_time % 1000000000);
+	}
+	fprintf(wr->file, ",%lu,%lu,", wr->start, end);
+	if (key) {
+		fprintf(wr->file, "\"%s\",%u,%u,", key->command, key->pid, key->uid);
+	} else {
+		fprintf(wr->file, "\"TOTAL\",,,");
+	}
+	fprintf(wr->file, "%s,", policy);
+	if (capacity) {
+		fprintf(wr->file, "%lu", capacity);
+	}
+	fprintf(wr->file, ",%lu,%.4f\n", accesses, hit_percent);
+}
+
+static struct linux_task_stats linux_delta(const struct linux_task_stats *now, const struct linux_task_stats *then) {
+	struct linux_task_stats delta = {
+		now->fma - then->fma,
+		now->faf - then->faf,
+		now->fmd - then->fmd,
+		now->mbd - then->mbd,
+	};
+	return delta;
+}
+
+// Simulated hit % of a window, corrected for sampling bias as
+// report_total_hit_percent does, given the accesses it should have seen
+static float window_hit_percent(struct window_report *wr, unsigned long hits, unsigned long misses, double expected_accesses) {
+	if (wr->sampler) {
+		return sampler_hit_percent(hits, hits + misses, expected_accesses);
+	}
+	return hits + misses ? 100.0 * hits / (hits + misses) : -1;
+}
+
+// Writes the window that ends right before event end and starts the next
+// one. Every simulation has to have replayed up to end, see replay_sync.
+void window_report_emit(struct window_report *wr, unsigned long end) {
+	struct linux_task_stats now = { wr->ls->fma, wr->ls->faf, wr->ls->fmd, wr->ls->mbd };
+	struct linux_task_stats real = linux_delta(&now, &wr->real);
+	unsigned long total_accesses = real.fma + real.faf + real.fmd + real.mbd;
+	double expected_accesses = wr->sampler ? wr->sampler->expected_accesses - wr->expected_accesses : 0;
+
+	window_report_row(wr, end, NULL, "Real", 0, total_accesses, calculate_linux_hit_percent(real.fma, real.faf, real.fmd, real.mbd));
+	for (int i = 0; i < wr->num_sims; i++) {
+		unsigned long hits = wr->sims[i]->hits - wr->sim_totals[i].hits;
+		unsigned long misses = wr->sims[i]->misses - wr->sim_totals[i].misses;
+		window_report_row(wr, end, NULL, wr->sims[i]->policy->name, wr->capacities[i], hits + misses, window_hit_percent(wr, hits, misses, expected_accesses));
+	}
+
+	for (unsigned int a = 0; a < wr->num_active; a++) {
+		unsigned int id = wr->active[a];
+		const struct task_key *key = task_table_key(wr->ls->tasks, id);
+		struct linux_task_stats task = linux_delta(&wr->ls->task_stats[id], &wr->real_tasks[id]);
+		unsigned long task_accesses = task.fma + task.faf + task.fmd + task.mbd;
+		window_report_row(wr, end, key, "Real", 0, task_accesses, calculate_linux_hit_percent(task.fma, task.faf, task.fmd, task.mbd));
+		for (int i = 0; i < wr->num_sims; i++) {
+			struct task_stats ts = policy_simulation_task_stats(wr->sims[i], id);
+			const struct task_stats *then = &wr->sim_tasks[(size_t)id * wr->num_sims + i];
+			unsigned long hits = ts.hits - then->hits;
+			unsigned long misses = ts.misses - then->misses;
+			double task_expected = total_accesses ? task_accesses * expected_accesses / total_accesses : 0;
+			window_report_row(wr, end, key, wr->sims[i]->policy->name, wr->capacities[i], hits + misses, window_hit_percent(wr, hits, misses, task_expected));
+		}
+		window_report_snapshot_task(wr, id);
+	}
+	fflush(wr->file);
+
+	window_report_snapshot_totals(wr);
+	wr->num_active = 0;
+	wr->num_windows++;
+	wr->start = end;
+}
+
+void window_report_close(struct window_report *wr) {
+	fclose(wr->file);
+	free(wr->sim_totals);
+	free(wr->real_tasks);
+	free(wr->sim_tasks);
+	free(wr->active);
+	free(wr->window_active);
+	free(wr);
+}
@@ -0,0 +1,58 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "common.h"
+#include "policy_simulation.h"
+#include "sampler.h"
+#include "report.h"
+
+
+/*
+ * Streams hit % per window of the replay to a CSV file, for the Real column
+ * and every simulation, overall and for each task active in the window.
+ * Counts are cumulative everywhere else, so each window is the difference
+ * from a snapshot taken at the end of the one before. Only the tasks that
+ * had accesses in a window are snapshotted and printed, so a window costs
+ * time proportional to its active tasks, however many tasks came before.
+ */
+struct window_report {
+	FILE *file;
+	struct policy_simulation **sims;
+	int num_sims;
+	// Unscaled capacity of each simulation, 0 if unbounded
+	const unsigned long *capacities;
+	struct linux_stats *ls;
+	struct sampler *sampler;
+	unsigned long num_windows;
+	// First event of the current window
+	unsigned long start;
+	// Time the current window starts at, in ns of Unix time, set by the
+	// caller. Left out of the CSV unless times is set, as CSV traces have none.
+	bool times;
+	unsigned long start_time;
+	// Totals at the start of the current window
+	struct linux_task_stats real;
+	struct task_stats *sim_totals;
+	double expected_accesses;
+	// Per-task counts at the start of the last window each task was active
+	// in, the Real counts and then num_sims simulation counts per task
+	struct linux_task_stats *real_tasks;
+	struct task_stats *sim_tasks;
+	unsigned int num_tasks;
+	// Tasks with accesses in the current window, each listed once
+	unsigned int *active;
+	unsigned int num_active;
+	// window_active[task] is num_windows + 1 if the task is in active
+	unsigned long *window_active;
+};
+
+
+struct window_report *window_report_init(const char *path, struct policy_simulation **sims, int num_sims, const unsigned long *capacities, struct linux_stats *ls, struct sampler *sampler, unsigned long start);
+void window_report_touch(struct window_report *wr, unsigned int task_id);
+void window_report_rescale(struct window_report *wr, double factor);
+void window_report_emit(struct window_report *wr, unsigned long end);
+void window_report_close(struct window_report *wr);
+
+#endif
@@ -0,0 +1,173 @@
+#include "workload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+
+const char *workload_pattern_names[NUM_WORKLOAD_PATTERNS] = {
+	"zipf",
+	"uniform",
+	"loop",
+	"sequential",
+	"mixed",
+};
+
+
+// Returns the pattern called name, or -1 if there is none
+int workload_parse_pattern(const char *name) {
+	for (int i = 0; i < NUM_WORKLOAD_PATTERNS; i++) {
+		if (!strcasecmp(name, workload_pattern_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// xorshift64, so traces are the same on every machine
+uint64_t workload_rand(struct workload *w) {
+	uint64_t x = w->rng;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	w->rng = x;
+	return x;
+}
+
+// Uniform in [0, 1)
+double workload_rand_double(struct workload *w) {
+	return (workload_rand(w) >> 11) * 0x1.0p-53;
+}
+
+/*
+ * Zipf ranks are sampled by rejection-inversion (Hormann and Derflinger), in
+ * constant time for any exponent and working set size. H is the integral of
+ * the rank density h(x) = x^-alpha, written with log1p and expm1 so it stays
+ * accurate at alpha = 1.
+ */
+
+double zipf_helper1(double x) {
+	return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+double zipf_helper2(double x) {
+	return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+double zipf_h(double alpha, double x) {
+	return exp(-alpha * log(x));
+}
+
+double zipf_h_integral(double alpha, double x) {
+	double log_x = log(x);
+	return zipf_helper2((1 - alpha) * log_x) * log_x;
+}
+
+double zipf_h_integral_inverse(double alpha, double x) {
+	double t = x * (1 - alpha);
+	if (t < -1) {
+		t = -1;
+	}
+	return exp(zipf_helper1(t) * x);
+}
+
+// Returns a rank in [0, num_folios), 0 being the most popular
+unsigned long workload_zipf(struct workload *w) {
+	double alpha = w->opts.alpha;
+	unsigned long n = w->opts.num_folios;
+	for (;;) {
+		double u = w->zipf_h_n + workload_rand_double(w) * (w->zipf_h_x1 - w->zipf_h_n);
+		double x = zipf_h_integral_inverse(alpha, u);
+		unsigned long k = x + 0.5;
+		if (k < 1) {
+			k = 1;
+		} else if (k > n) {
+			k = n;
+		}
+		if (k - x <= w->zipf_s || u >= zipf_h_integral(alpha, k + 0.5) - zipf_h(alpha, k)) {
+			return k - 1;
+		}
+	}
+}
+
+struct workload *workload_init(const struct workload_opts *opts) {
+	struct workload *w = (struct workload *)calloc(1, sizeof(struct workload));
+	w->opts = *opts;
+	if (!w->opts.num_folios) {
+		w->opts.num_folios = 1;
+	}
+	if (!w->opts.num_tasks) {
+		w->opts.num_tasks = 1;
+	}
+	// xorshift never leaves 0
+	w->rng = opts->seed ? opts->seed : 0x9e3779b97f4a7c15;
+
+	unsigned int num_tasks = w->opts.num_tasks;
+	int mixed = w->opts.pattern == WORKLOAD_MIXED;
+	w->tasks = (struct workload_task *)calloc(num_tasks, sizeof(struct workload_task));
+	for (unsigned int i = 0; i < num_tasks; i++) {
+		struct workload_task *t = &w->tasks[i];
+		t->pattern = mixed ? (enum workload_pattern)(i % WORKLOAD_MIXED) : w->opts.pattern;
+		t->base = mixed ? i * w->opts.num_folios : 0;
+		t->key.uid = 1000;
+		t->key.pid = 1000 + i;
+		snprintf(t->key.command, sizeof(t->key.command), "%s-%u", workload_pattern_names[t->pattern], i);
+	}
+
+	w->num_working_set = mixed ? num_tasks * w->opts.num_folios : w->opts.num_folios;
+	w->added = (uint64_t *)calloc((w->num_working_set + 63) / 64, sizeof(uint64_t));
+	w->next_sequential = w->num_working_set;
+
+	double alpha = w->opts.alpha;
+	w->zipf_h_x1 = zipf_h_integral(alpha, 1.5) - 1;
+	w->zipf_h_n = zipf_h_integral(alpha, w->opts.num_folios + 0.5);
+	w->zipf_s = 2 - zipf_h_integral_inverse(alpha, zipf_h_integral(alpha, 2.5) - zipf_h(alpha, 2));
+
+	return w;
+}
+
+void workload_next(struct workload *w, struct event *e) {
+	if (!w->run_remaining) {
+		w->current_task = workload_rand(w) % w->opts.num_tasks;
+		w->run_remaining = 1 + workload_rand(w) % WORKLOAD_MAX_RUN;
+	}
+	w->run_remaining--;
+	struct workload_task *t = &w->tasks[w->current_task];
+
+	unsigned long index;
+	switch (t->pattern) {
+		case WORKLOAD_ZIPF:
+			index = t->base + workload_zipf(w);
+			break;
+		case WORKLOAD_UNIFORM:
+			index = t->base + workload_rand(w) % w->opts.num_folios;
+			break;
+		case WORKLOAD_LOOP:
+			index = t->base + t->cursor;
+			t->cursor = (t->cursor + 1) % w->opts.num_folios;
+			break;
+		default:
+			index = w->next_sequential++;
+			break;
+	}
+
+	memset(e, 0, sizeof(struct event));
+	e->type = FMA;
+	if (index >= w->num_working_set) {
+		e->type = FAF;
+	} else if (!(w->added[index / 64] & (1UL << (index % 64)))) {
+		w->added[index / 64] |= 1UL << (index % 64);
+		e->type = FAF;
+	}
+	e->folio = WORKLOAD_FOLIO_BASE + index * WORKLOAD_FOLIO_STRIDE;
+	e->count = 1;
+	e->key = t->key;
+	e->task_id = w->current_task;
+}
+
+void workload_destroy(struct workload *w) {
+	free(w->tasks);
+	free(w->added);
+	free(w);
+}
@@ -0,0 +1,77 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+#include "common.h"
+
+// Folios are spaced like struct folio pointers into the kernel's vmemmap
+#define WORKLOAD_FOLIO_BASE 0xffffea0000000000UL
+#define WORKLOAD_FOLIO_STRIDE 64
+// Longest run of events from one task before switching to another
+#define WORKLOAD_MAX_RUN 64
+
+
+enum workload_pattern {
+	// Zipf-distributed accesses over the working set
+	WORKLOAD_ZIPF,
+	// Uniformly random accesses over the working set
+	WORKLOAD_UNIFORM,
+	// Scans the working set in order, over and over
+	WORKLOAD_LOOP,
+	// Streams through new folios, never returning to one
+	WORKLOAD_SEQUENTIAL,
+	// Every task gets its own working set and the next of the patterns above
+	WORKLOAD_MIXED,
+	NUM_WORKLOAD_PATTERNS,
+};
+
+struct workload_opts {
+	enum workload_pattern pattern;
+	// Folios in each working set
+	unsigned long num_folios;
+	unsigned int num_tasks;
+	// Zipf exponent
+	double alpha;
+	uint64_t seed;
+};
+
+struct workload_task {
+	struct task_key key;
+	enum workload_pattern pattern;
+	// Index of the task's first folio, and how far its scan has got
+	unsigned long base;
+	unsigned long cursor;
+};
+
+/*
+ * Generates a repeatable stream of accesses. The first access to a folio is a
+ * filemap_add_folio and the rest are folio_mark_accessed, so every folio is
+ * added to the page cache before it is used. Tasks take turns in runs of up
+ * to WORKLOAD_MAX_RUN events.
+ */
+struct workload {
+	struct workload_opts opts;
+	struct workload_task *tasks;
+	unsigned int current_task;
+	unsigned int run_remaining;
+	// One bit per working set folio, set once it has been added
+	uint64_t *added;
+	unsigned long num_working_set;
+	// The next folio index of the sequential patterns, past every working set
+	unsigned long next_sequential;
+	uint64_t rng;
+	// Rejection-inversion constants for sampling Zipf ranks
+	double zipf_h_x1;
+	double zipf_h_n;
+	double zipf_s;
+};
+
+
+extern const char *workload_pattern_names[NUM_WORKLOAD_PATTERNS];
+
+int workload_parse_pattern(const char *name);
+struct workload *workload_init(const struct workload_opts *opts);
+void workload_next(struct workload *w, struct event *e);
+void workload_destroy(struct workload *w);
+
+#endif